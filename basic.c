@@ -70,7 +70,49 @@
 #define HASSTEFANSEXT
 #define HASERRORMSG
 #define HASVT52
+#define HASKEYWORDINDEX
+#define HASMULTIDIM
 #undef HASFLOAT
+#undef HASLONGADDRESS
+
+// runtime caches of the interpreter, these trade memory for speed
+#define HASRAMTOKEN
+#define HASLINEINDEX
+#define HASHEAPINDEX
+#define HASFORINDEX
+#define HASVARINDEX
+#define HASFUSE
+#define HASFOLD
+
+// expressions evaluated in one loop instead of the recursive descent, SET 15
+#define HASPRATT
+
+// AND and OR skip their right side once the result is known, SET 16
+#define HASSHORTCIRCUIT
+
+// the compiler for RUN, switched on at runtime with SET 6,1
+#define HASCOMPILER
+
+// buffered console output, SET 7,0 writes every character
+#define HASOUTBUFFER
+
+// stacks sized with -s, -g, -f or SET 9, 10, 11 instead of the constants
+#define HASDYNSTACKS
+
+// the line profiler, switched on with SET 8,1 or -p, reported by PROFILE
+#define HASPROFILER
+
+// many interpreters in one process with basiccreate() and basicrun()
+#define HASCONTEXT
+
+// statement and time limits of RUN and CONT, set with SET 12, 13 or -t
+#define HASBUDGET
+
+// run programs on all cores with -b, the console of a job is in memory
+#define HASBATCH
+
+// FILL, COPY, SUM, MIN, MAX and DOT on whole arrays
+#define HASARRAYOPS
 
 
 // hardcoded memory size set 0 for automatic malloc
@@ -112,6 +154,45 @@
 #undef ARDUINOPROGMEM
 #undef ARDUINOEEPROM
 #endif
+// the runtime caches need more memory than a microcontroller has 
+#ifdef ARDUINO
+#undef HASRAMTOKEN
+#undef HASLINEINDEX
+#undef HASHEAPINDEX
+#undef HASFORINDEX
+#undef HASVARINDEX
+#undef HASFUSE
+#undef HASFOLD
+#undef HASPRATT
+#undef HASSHORTCIRCUIT
+#undef HASCOMPILER
+#undef HASOUTBUFFER
+#undef HASDYNSTACKS
+#undef HASPROFILER
+#undef HASCONTEXT
+#undef HASBUDGET
+#undef HASBATCH
+#endif
+// a context needs the memory and the stacks on the heap
+#if MEMSIZE != 0 || !defined(HASDYNSTACKS)
+#undef HASCONTEXT
+#endif
+// the variable index, the array operations and matrices need the heap
+#ifndef HASAPPLE1
+#undef HASVARINDEX
+#undef HASARRAYOPS
+#undef HASMULTIDIM
+#endif
+// the batch runs contexts in forked processes from main()
+#if !defined(HASCONTEXT) || defined(MINGW) || defined(BASICLIB)
+#undef HASBATCH
+#endif
+// the library exports nothing but the functions of basic.h
+#ifdef BASICLIB
+#define LIBLOCAL static
+#else
+#define LIBLOCAL
+#endif
 #ifdef ARDUINO
 #ifdef ARDUINOPS2
 #ifndef ESP8266
@@ -133,10 +214,14 @@
 #include <SPI.h>
 #include <SD.h>
 #endif
+#ifdef HASARRAYOPS
+#include <string.h>
+#endif
 #else 
 #define PROGMEM
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef HASFLOAT
 #include <math.h>
 #include <float.h>
@@ -144,18 +229,23 @@
 #include <time.h>
 #include <sys/types.h>
 #include <dirent.h>
+#ifdef HASBATCH
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
 #endif
 
 // Arduino default serial baudrate
 #ifdef ARDUINO
-const int serial_baudrate = 9600;
+LIBLOCAL const int serial_baudrate = 9600;
 #else 
-const int serial_baudrate = 0;
+LIBLOCAL const int serial_baudrate = 0;
 #endif
 #ifdef ARDUINOPRT
-const int printer_baudrate = 9600;
+LIBLOCAL const int printer_baudrate = 9600;
 #else
-const int printer_baudrate = 0;
+LIBLOCAL const int printer_baudrate = 0;
 #endif
 
 // general definitions
@@ -168,6 +258,7 @@ const int printer_baudrate = 0;
 // various buffer sizes
 #define BUFSIZE 	92
 #define SBUFSIZE	32
+#define OBUFSIZE	4096
 #define VARSIZE		26
 #define STACKSIZE 	15
 #define GOSUBDEPTH 	4
@@ -259,6 +350,15 @@ const int printer_baudrate = 0;
 // low level access of internal routines
 #define TUSR	-60
 #define TCALL 	-59
+// performance tools (1)
+#define TPROFILE -58
+// whole array operations (6)
+#define TFILL	-57
+#define TCOPY	-56
+#define TSUM	-55
+#define TMIN	-54
+#define TMAX	-53
+#define TDOT	-52
 // currently unused constants
 #define TERROR  -3
 #define UNKNOWN -2
@@ -266,7 +366,7 @@ const int printer_baudrate = 0;
 
 
 // the number of keywords, and the base index of the keywords
-#define NKEYWORDS	3+19+14+11+10+4+2
+#define NKEYWORDS	3+19+14+11+10+4+2+1+6
 #define BASEKEYWORD -121
 
 /*
@@ -300,77 +400,86 @@ const int printer_baudrate = 0;
 	All BASIC keywords
 */
 
-const char sge[]   PROGMEM = "=>";
-const char sle[]   PROGMEM = "<=";
-const char sne[]   PROGMEM = "<>";
+LIBLOCAL const char sge[]   PROGMEM = "=>";
+LIBLOCAL const char sle[]   PROGMEM = "<=";
+LIBLOCAL const char sne[]   PROGMEM = "<>";
 // Palo Alto language set
-const char sprint[]  PROGMEM = "PRINT";
-const char slet[]    PROGMEM = "LET";
-const char sinput[]  PROGMEM = "INPUT";
-const char sgoto[]   PROGMEM = "GOTO";
-const char sgosub[]  PROGMEM = "GOSUB";
-const char sreturn[] PROGMEM = "RETURN";
-const char sif[]     PROGMEM = "IF";
-const char sfor[]    PROGMEM = "FOR";
-const char sto[]     PROGMEM = "TO";
-const char sstep[]   PROGMEM = "STEP";
-const char snext[]   PROGMEM = "NEXT";
-const char sstop[]   PROGMEM = "STOP";
-const char slist[]   PROGMEM = "LIST";
-const char snew[]    PROGMEM = "NEW";
-const char srun[]  	 PROGMEM = "RUN";
-const char sabs[]    PROGMEM = "ABS";
-const char srnd[]    PROGMEM = "RND";
-const char ssize[]   PROGMEM = "SIZE";
-const char srem[]    PROGMEM = "REM";
+LIBLOCAL const char sprint[]  PROGMEM = "PRINT";
+LIBLOCAL const char slet[]    PROGMEM = "LET";
+LIBLOCAL const char sinput[]  PROGMEM = "INPUT";
+LIBLOCAL const char sgoto[]   PROGMEM = "GOTO";
+LIBLOCAL const char sgosub[]  PROGMEM = "GOSUB";
+LIBLOCAL const char sreturn[] PROGMEM = "RETURN";
+LIBLOCAL const char sif[]     PROGMEM = "IF";
+LIBLOCAL const char sfor[]    PROGMEM = "FOR";
+LIBLOCAL const char sto[]     PROGMEM = "TO";
+LIBLOCAL const char sstep[]   PROGMEM = "STEP";
+LIBLOCAL const char snext[]   PROGMEM = "NEXT";
+LIBLOCAL const char sstop[]   PROGMEM = "STOP";
+LIBLOCAL const char slist[]   PROGMEM = "LIST";
+LIBLOCAL const char snew[]    PROGMEM = "NEW";
+LIBLOCAL const char srun[]  	 PROGMEM = "RUN";
+LIBLOCAL const char sabs[]    PROGMEM = "ABS";
+LIBLOCAL const char srnd[]    PROGMEM = "RND";
+LIBLOCAL const char ssize[]   PROGMEM = "SIZE";
+LIBLOCAL const char srem[]    PROGMEM = "REM";
 // Apple 1 language set
-const char snot[]    PROGMEM = "NOT";
-const char sand[]    PROGMEM = "AND";
-const char sor[]     PROGMEM = "OR";
-const char slen[]    PROGMEM = "LEN";
-const char ssgn[]    PROGMEM = "SGN";
-const char speek[]   PROGMEM = "PEEK";
-const char sdim[]    PROGMEM = "DIM";
-const char sclr[]    PROGMEM = "CLR";
-const char slomem[]  PROGMEM = "LOMEM";
-const char shimem[]  PROGMEM = "HIMEM";
-const char stab[]    PROGMEM = "TAB";
-const char sthen[]   PROGMEM = "THEN";
-const char send[]    PROGMEM = "END";
-const char spoke[]   PROGMEM = "POKE";
+LIBLOCAL const char snot[]    PROGMEM = "NOT";
+LIBLOCAL const char sand[]    PROGMEM = "AND";
+LIBLOCAL const char sor[]     PROGMEM = "OR";
+LIBLOCAL const char slen[]    PROGMEM = "LEN";
+LIBLOCAL const char ssgn[]    PROGMEM = "SGN";
+LIBLOCAL const char speek[]   PROGMEM = "PEEK";
+LIBLOCAL const char sdim[]    PROGMEM = "DIM";
+LIBLOCAL const char sclr[]    PROGMEM = "CLR";
+LIBLOCAL const char slomem[]  PROGMEM = "LOMEM";
+LIBLOCAL const char shimem[]  PROGMEM = "HIMEM";
+LIBLOCAL const char stab[]    PROGMEM = "TAB";
+LIBLOCAL const char sthen[]   PROGMEM = "THEN";
+LIBLOCAL const char send[]    PROGMEM = "END";
+LIBLOCAL const char spoke[]   PROGMEM = "POKE";
 // Stefan's tinybasic additions
-const char scont[]   PROGMEM = "CONT";
-const char ssqr[]    PROGMEM = "SQR";
-const char sfre[]    PROGMEM = "FRE";
-const char sdump[]   PROGMEM = "DUMP";
-const char sbreak[]  PROGMEM = "BREAK";
-const char ssave[]   PROGMEM = "SAVE";
-const char sload[]   PROGMEM = "LOAD";
-const char sget[]    PROGMEM = "GET";
-const char sput[]    PROGMEM = "PUT";
-const char sset[]    PROGMEM = "SET";
-const char scls[]    PROGMEM = "CLS";
+LIBLOCAL const char scont[]   PROGMEM = "CONT";
+LIBLOCAL const char ssqr[]    PROGMEM = "SQR";
+LIBLOCAL const char sfre[]    PROGMEM = "FRE";
+LIBLOCAL const char sdump[]   PROGMEM = "DUMP";
+LIBLOCAL const char sbreak[]  PROGMEM = "BREAK";
+LIBLOCAL const char ssave[]   PROGMEM = "SAVE";
+LIBLOCAL const char sload[]   PROGMEM = "LOAD";
+LIBLOCAL const char sget[]    PROGMEM = "GET";
+LIBLOCAL const char sput[]    PROGMEM = "PUT";
+LIBLOCAL const char sset[]    PROGMEM = "SET";
+LIBLOCAL const char scls[]    PROGMEM = "CLS";
 // Arduino functions
-const char spinm[]   PROGMEM = "PINM";
-const char sdwrite[] PROGMEM = "DWRITE";
-const char sdread[]  PROGMEM = "DREAD";
-const char sawrite[] PROGMEM = "AWRITE";
-const char saread[]  PROGMEM = "AREAD";
-const char sdelay[]  PROGMEM = "DELAY";
-const char smillis[]  PROGMEM = "MILLIS";
-const char stone[]    PROGMEM = "ATONE";
-const char splusein[] PROGMEM = "PULSEIN";
-const char sazero[]   PROGMEM = "AZERO";
+LIBLOCAL const char spinm[]   PROGMEM = "PINM";
+LIBLOCAL const char sdwrite[] PROGMEM = "DWRITE";
+LIBLOCAL const char sdread[]  PROGMEM = "DREAD";
+LIBLOCAL const char sawrite[] PROGMEM = "AWRITE";
+LIBLOCAL const char saread[]  PROGMEM = "AREAD";
+LIBLOCAL const char sdelay[]  PROGMEM = "DELAY";
+LIBLOCAL const char smillis[]  PROGMEM = "MILLIS";
+LIBLOCAL const char stone[]    PROGMEM = "ATONE";
+LIBLOCAL const char splusein[] PROGMEM = "PULSEIN";
+LIBLOCAL const char sazero[]   PROGMEM = "AZERO";
 // SD Card DOS functions
-const char scatalog[] PROGMEM = "CATALOG";
-const char sdelete[] PROGMEM = "DELETE";
-const char sfopen[] PROGMEM = "OPEN";
-const char sfclose[] PROGMEM = "CLOSE";
+LIBLOCAL const char scatalog[] PROGMEM = "CATALOG";
+LIBLOCAL const char sdelete[] PROGMEM = "DELETE";
+LIBLOCAL const char sfopen[] PROGMEM = "OPEN";
+LIBLOCAL const char sfclose[] PROGMEM = "CLOSE";
 // low level access functions
-const char susr[] PROGMEM = "USR";
-const char scall[] PROGMEM = "CALL";
-
-const char* const keyword[] PROGMEM = {
+LIBLOCAL const char susr[] PROGMEM = "USR";
+LIBLOCAL const char scall[] PROGMEM = "CALL";
+// performance tools
+LIBLOCAL const char sprofile[] PROGMEM = "PROFILE";
+// whole array operations
+LIBLOCAL const char sfill[] PROGMEM = "FILL";
+LIBLOCAL const char scopy[] PROGMEM = "COPY";
+LIBLOCAL const char ssum[] PROGMEM = "SUM";
+LIBLOCAL const char smin[] PROGMEM = "MIN";
+LIBLOCAL const char smax[] PROGMEM = "MAX";
+LIBLOCAL const char sdot[] PROGMEM = "DOT";
+
+LIBLOCAL const char* const keyword[] PROGMEM = {
 // Palo Alto BASIC
 	sge, sle, sne, sprint, slet, sinput, 
 	sgoto, sgosub, sreturn, sif, sfor, sto,
@@ -389,7 +498,11 @@ const char* const keyword[] PROGMEM = {
 // SD Card DOS
     scatalog, sdelete, sfopen, sfclose,
 // low level access
-    susr, scall
+    susr, scall,
+// performance tools
+    sprofile,
+// whole array operations
+    sfill, scopy, ssum, smin, smax, sdot
 // the end 
 };
 
@@ -422,33 +535,33 @@ const char* const keyword[] PROGMEM = {
 #define EEEPROM		 21
 #define ESDCARD		 22
 
-const char mfile[]    	PROGMEM = "file.bas";
-const char mprompt[]	PROGMEM = "> ";
-const char mgreet[]		PROGMEM = "Stefan's Basic 1.2";
-const char egeneral[]  	PROGMEM = "Error";
+LIBLOCAL const char mfile[]    	PROGMEM = "file.bas";
+LIBLOCAL const char mprompt[]	PROGMEM = "> ";
+LIBLOCAL const char mgreet[]		PROGMEM = "Stefan's Basic 1.2";
+LIBLOCAL const char egeneral[]  	PROGMEM = "Error";
 #ifdef HASERRORMSG
-const char eunknown[]  	PROGMEM = "Syntax";
-const char enumber[]	PROGMEM = "Number";
-const char edivide[]  	PROGMEM = "Div by 0";
-const char eline[]  	PROGMEM = "Unknown Line";
-const char ereturn[]    PROGMEM = "Return";
-const char enext[]		PROGMEM = "Next";
-const char egosub[] 	PROGMEM = "GOSUB";
-const char efor[]		PROGMEM = "FOR";
-const char emem[]  	   	PROGMEM = "Memory";
-const char estack[]    	PROGMEM = "Stack";
-const char edim[]		PROGMEM = "DIM";
-const char erange[]  	PROGMEM = "Range";
-const char estring[]	PROGMEM = "String";
-const char evariable[]  PROGMEM = "Variable";
-const char efile[]  	PROGMEM = "File";
-const char efun[] 	 	PROGMEM = "Function";
-const char eargs[]  	PROGMEM = "Args";
-const char eeeprom[]	PROGMEM = "EEPROM";
-const char esdcard[]	PROGMEM = "SD card";
-#endif
-
-const char* const message[] PROGMEM = {
+LIBLOCAL const char eunknown[]  	PROGMEM = "Syntax";
+LIBLOCAL const char enumber[]	PROGMEM = "Number";
+LIBLOCAL const char edivide[]  	PROGMEM = "Div by 0";
+LIBLOCAL const char eline[]  	PROGMEM = "Unknown Line";
+LIBLOCAL const char ereturn[]    PROGMEM = "Return";
+LIBLOCAL const char enext[]		PROGMEM = "Next";
+LIBLOCAL const char egosub[] 	PROGMEM = "GOSUB";
+LIBLOCAL const char efor[]		PROGMEM = "FOR";
+LIBLOCAL const char emem[]  	   	PROGMEM = "Memory";
+LIBLOCAL const char estack[]    	PROGMEM = "Stack";
+LIBLOCAL const char edim[]		PROGMEM = "DIM";
+LIBLOCAL const char erange[]  	PROGMEM = "Range";
+LIBLOCAL const char estring[]	PROGMEM = "String";
+LIBLOCAL const char evariable[]  PROGMEM = "Variable";
+LIBLOCAL const char efile[]  	PROGMEM = "File";
+LIBLOCAL const char efun[] 	 	PROGMEM = "Function";
+LIBLOCAL const char eargs[]  	PROGMEM = "Args";
+LIBLOCAL const char eeeprom[]	PROGMEM = "EEPROM";
+LIBLOCAL const char esdcard[]	PROGMEM = "SD card";
+#endif
+
+LIBLOCAL const char* const message[] PROGMEM = {
 	mfile, mprompt, mgreet, egeneral
 #ifdef HASERRORMSG
 	, eunknown, enumber, edivide, eline, ereturn, 
@@ -463,6 +576,7 @@ const char* const message[] PROGMEM = {
 // the original code was 16 bit but can be extended here
 // works but with the tacit assumption that 
 // sizeof(number_t) >= sizeof(address_t) 
+// HASLONGADDRESS makes addresses and line numbers 32 bit
 // floating point here is under construction we always 
 // assume that float >= 4 bytes in the following
 #ifdef HASFLOAT
@@ -470,17 +584,22 @@ typedef float number_t;
 #else
 typedef int number_t;
 #endif
+#ifdef HASLONGADDRESS
+typedef unsigned int address_t;
+#else
 typedef unsigned short address_t;
-const int numsize=sizeof(number_t);
-const int addrsize=sizeof(address_t);
-const int eheadersize=sizeof(address_t)+1;
-const int strindexsize=2; // the index size of strings either 1 byte or 2 bytes - no other values supported
+#endif
+LIBLOCAL const int numsize=sizeof(number_t);
+LIBLOCAL const int addrsize=sizeof(address_t);
+LIBLOCAL const int eheadersize=sizeof(address_t)+1;
+LIBLOCAL const char bimageversion=1; // the version of the binary program image of SAVE "file",1
+LIBLOCAL const int strindexsize=2; // the index size of strings either 1 byte or 2 bytes - no other values supported
 #ifndef HASFLOAT
-const number_t maxnum=(number_t)~((number_t)1<<(sizeof(number_t)*8-1));
+LIBLOCAL const number_t maxnum=(number_t)~((number_t)1<<(sizeof(number_t)*8-1));
 #else 
-const number_t maxnum=16777216; // we use the maximum accurate(!) integer of a 32 bit float here 
+LIBLOCAL const number_t maxnum=16777216; // we use the maximum accurate(!) integer of a 32 bit float here 
 #endif
-const address_t maxaddr=(address_t)(~0); 
+LIBLOCAL const address_t maxaddr=(address_t)(~0); 
 
 /*
 	The basic interpreter is implemented as a stack machine
@@ -522,12 +641,62 @@ const address_t maxaddr=(address_t)(~0);
 
 	fnc counts the depth of for - next loop nesting
 
+	keywordfirst and keywordnext chain all keywords with the 
+		same first character in the order of keyword[]
+
 	ifd, ofd are the filedescriptors for input/output
 	ifile and ofile their Arduino SD card analoga
 
+	obuffer collects the console output until outflush()
+
+	profile counts the statements and the microseconds spent 
+		in them for each line if profiling is set, it is a hash 
+		table of the line numbers,
+		profilecount all statements and profilefree the 
+		least free memory of the run
+
+	lineindex is a table of all line numbers and their 
+		addresses sorted by line number, nlines is its length.
+		lineindexlast is the entry of the last line skipped.
+
+	heapindex is a hash table of the objects on the heap.
+
+	forindex is a hash table of the places findnext() started 
+		from and the NEXT it found. 
+
+	varindex maps the program position of a variable token to 
+		the heap address of the variable.
+
+	fuseindex is the shape of the statement at a program position 
+		if it runs as a superinstruction, fusecount counts them.
+
+	foldindex is a hash table of the positions where a run of 
+		numbers and operators starts, its values and where it ends. 
+		folding switches it on, foldhits counts its use.
+
+	prattmode selects the evaluator of expression().
+
+	shortcircuit switches short circuit AND and OR on, skipindex 
+		is a hash table of the right sides they skipped and where 
+		they end, skipcount counts the skips.
+
+	ccode is the compiled program, cstmt and clines map 
+		statement addresses and line numbers to it. 
+
 
 */
+#ifdef HASKEYWORDINDEX
+static signed char keywordfirst['Z'-'<'+1];
+static signed char keywordnext[NKEYWORDS];
+#endif
+
+#ifdef HASDYNSTACKS
+static number_t* stack;
+static address_t stacksize = STACKSIZE;
+#else
 static number_t stack[STACKSIZE];
+const address_t stacksize = STACKSIZE;
+#endif
 static address_t sp=0; 
 
 static char sbuffer[SBUFSIZE];
@@ -544,19 +713,141 @@ static address_t memsize = MEMSIZE-1;
 #else
 static signed char* mem;
 static address_t himem, memsize;
+static address_t memrequest = 0;
 #endif
 
 #ifdef HASFORNEXT
+#ifdef HASDYNSTACKS
+static struct {char varx; char vary; address_t here; number_t to; number_t step;} *forstack;
+static short fordepth = FORDEPTH;
+#else
 static struct {char varx; char vary; address_t here; number_t to; number_t step;} forstack[FORDEPTH];
+const short fordepth = FORDEPTH;
+#endif
 static short forsp = 0;
 static char fnc; 
 #endif
 
 #ifdef HASGOSUB
+#ifdef HASDYNSTACKS
+static address_t* gosubstack;
+static short gosubdepth = GOSUBDEPTH;
+#else
 static address_t gosubstack[GOSUBDEPTH];
+const short gosubdepth = GOSUBDEPTH;
+#endif
 static short gosubsp = 0;
 #endif
 
+// LOAD appends lines in ascending order, lastline is the last line of the program
+// loadtime in microseconds and loadlines of the last LOAD for USR(9,4) and USR(9,5)
+static char appendmode = FALSE;
+static address_t lastline = 0;
+static unsigned long loadtime = 0;
+static address_t loadlines = 0;
+
+#ifdef HASLINEINDEX
+static struct {address_t line; address_t addr;} *lineindex;
+static address_t lineindexsize = 0;
+static address_t nlines = 0;
+static char lineindexvalid = FALSE;
+static address_t lineindexlast = 0;
+static unsigned long lineindexhits = 0;
+static unsigned long lineindexmisses = 0;
+#endif
+
+#ifdef HASFORINDEX
+static struct {address_t f; address_t n;} *forindex;
+static address_t forindexsize = 0;
+static address_t forindexused = 0;
+static char forindexvalid = FALSE;
+static unsigned long forindexhits = 0;
+static unsigned long forindexmisses = 0;
+#endif
+
+#ifdef HASVARINDEX
+static address_t* varindex;
+static address_t varindexsize = 0;
+static char varindexvalid = FALSE;
+static unsigned long varindexhits = 0;
+static unsigned long varindexmisses = 0;
+#endif
+
+#ifdef HASFUSE
+static signed char* fuseindex;
+static address_t fuseindexsize = 0;
+static char fuseindexvalid = FALSE;
+static unsigned long fusecount = 0;
+#endif
+
+#ifdef HASFOLD
+static struct {address_t p; address_t s; address_t t; address_t m; number_t vs; number_t vt; number_t vm; char e;} *foldindex;
+static address_t foldindexsize = 0;
+static char foldindexvalid = FALSE;
+static char folding = TRUE;
+static unsigned long foldhits = 0;
+
+#define FOLDEXPRESSION	0
+#define FOLDSUM		1
+#define FOLDTERM	2
+#define FOLDPRODUCT	3
+#endif
+
+#ifdef HASPRATT
+static char prattmode = FALSE;
+#endif
+
+#ifdef HASSHORTCIRCUIT
+static char shortcircuit = FALSE;
+static struct {address_t p; address_t e;} *skipindex;
+static address_t skipindexsize = 0;
+static address_t skipindexused = 0;
+static char skipindexvalid = FALSE;
+static unsigned long skipcount = 0;
+#endif
+
+#ifdef HASPROFILER
+static struct {address_t l; unsigned long n; unsigned long t;} *profile;
+static address_t profilesize = 0;
+static address_t profileused = 0;
+static char profiling = FALSE;
+static address_t profileslot = 0;
+static unsigned long profiletime = 0;
+static unsigned long profilecount = 0;
+static address_t profilefree = 0;
+#endif
+
+#ifdef HASHEAPINDEX
+static struct {signed char t; char c; char d; address_t a; address_t l;} *heapindex;
+static address_t heapindexsize = 0;
+#endif
+
+#ifdef HASCOMPILER
+static struct ccell {signed char op; char c; char d; address_t a; number_t n; void (*f)();} *ccode;
+static struct {address_t a; address_t pc;} *cstmt;
+static struct {address_t l; address_t pc;} *clines;
+static address_t csize = 0;
+static address_t ncode = 0;
+static address_t ncstmt = 0;
+static address_t nclines = 0;
+static address_t ca;
+static address_t cpc;
+static address_t cfixup;
+static short cdepth;
+static short cmaxdepth = 0;
+static char cfail;
+static char cmode = FALSE;
+static char cvalid = FALSE;
+static char crunning = FALSE;
+static char cstep = FALSE;
+#ifdef HASDYNSTACKS
+static struct {address_t a; address_t pc;} *cforcache, *cgosubcache;
+#else
+static struct {address_t a; address_t pc;} cforcache[FORDEPTH], cgosubcache[GOSUBDEPTH];
+#endif
+static unsigned long cfallbacks = 0;
+#endif
+
 static number_t x, y;
 static signed char xc, yc;
 
@@ -591,8 +882,34 @@ static unsigned char odd = OSERIAL;
 #endif
 
 #ifndef ARDUINO
-FILE* ifd;
-FILE* ofd;
+LIBLOCAL FILE* ifd;
+LIBLOCAL FILE* ofd;
+#ifdef HASOUTBUFFER
+static char obuffer[OBUFSIZE];
+static short obi = 0;
+static char obuffered = TRUE;
+#endif
+#ifdef HASCONTEXT
+static char memconsole = FALSE;
+static void (*consolesink)(char, void*) = NULL;
+static void* consoledata = NULL;
+static const char* consoleinput = NULL;
+static long consoleinputsize = 0;
+static long consoleinputpos = 0;
+#endif
+#ifdef HASBUDGET
+static char budgeting = FALSE;
+static char budgetstop = FALSE;
+static unsigned long budget = 0;
+static unsigned long budgetlimit = 0;
+static unsigned long timelimit = 0;
+static unsigned long deadline = 0;
+#endif
+#ifdef HASBATCH
+static char* boutput = NULL;
+static long boutputsize = 0;
+static long boutputlen = 0;
+#endif
 #else 
 #ifdef ARDUINOSD
 File ifile;
@@ -601,6 +918,79 @@ File ofile;
 #endif
 #endif
 
+/*
+	A context holds the state of one interpreter. basicrun() 
+	exchanges it with the variables above, runs a line of input 
+	and exchanges it back, the functions of the interpreter are 
+	unchanged. The console and the keyword index are shared.
+*/
+
+#ifdef HASCONTEXT
+struct basiccontext {
+	signed char* mem; address_t himem; address_t memsize;
+	number_t* stack; address_t stacksize; address_t sp;
+	char ibuffer[BUFSIZE]; char* bi;
+	number_t vars[VARSIZE];
+#ifdef HASFORNEXT
+	void* forstack; short fordepth; short forsp; char fnc;
+#endif
+#ifdef HASGOSUB
+	address_t* gosubstack; short gosubdepth; short gosubsp;
+#endif
+	char appendmode; address_t lastline; unsigned long loadtime; address_t loadlines;
+#ifdef HASLINEINDEX
+	void* lineindex; address_t lineindexsize; address_t nlines; char lineindexvalid; 
+	address_t lineindexlast; unsigned long lineindexhits; unsigned long lineindexmisses;
+#endif
+#ifdef HASFORINDEX
+	void* forindex; address_t forindexsize; address_t forindexused; char forindexvalid;
+	unsigned long forindexhits; unsigned long forindexmisses;
+#endif
+#ifdef HASVARINDEX
+	address_t* varindex; address_t varindexsize; char varindexvalid;
+	unsigned long varindexhits; unsigned long varindexmisses;
+#endif
+#ifdef HASFUSE
+	signed char* fuseindex; address_t fuseindexsize; char fuseindexvalid; unsigned long fusecount;
+#endif
+#ifdef HASFOLD
+	void* foldindex; address_t foldindexsize; char foldindexvalid; char folding; unsigned long foldhits;
+#endif
+#ifdef HASPRATT
+	char prattmode;
+#endif
+#ifdef HASSHORTCIRCUIT
+	char shortcircuit; void* skipindex; address_t skipindexsize; address_t skipindexused; 
+	char skipindexvalid; unsigned long skipcount;
+#endif
+#ifdef HASPROFILER
+	void* profile; address_t profilesize; address_t profileused; char profiling;
+	address_t profileslot; unsigned long profiletime; unsigned long profilecount; address_t profilefree;
+#endif
+#ifdef HASHEAPINDEX
+	void* heapindex; address_t heapindexsize;
+#endif
+#ifdef HASCOMPILER
+	struct ccell* ccode; void* cstmt; void* clines; 
+	address_t csize; address_t ncode; address_t ncstmt; address_t nclines;
+	address_t ca; address_t cpc; address_t cfixup; short cdepth; short cmaxdepth; 
+	char cfail; char cmode; char cvalid; char crunning; char cstep;
+	void* cforcache; void* cgosubcache; unsigned long cfallbacks;
+#endif
+	number_t x; number_t y; signed char xc; signed char yc; union accunumber z;
+	char* ir; char* ir2; signed char token; signed char er; signed char ert;
+	signed char st; address_t here; address_t top; address_t nvars; char form; address_t rd;
+	unsigned char id; unsigned char od; unsigned char idd; unsigned char odd;
+	FILE* ifd; FILE* ofd;
+	char memconsole; void (*consolesink)(char, void*); void* consoledata;
+	const char* consoleinput; long consoleinputsize; long consoleinputpos;
+#ifdef HASBUDGET
+	char budgeting; char budgetstop; unsigned long budget;
+	unsigned long budgetlimit; unsigned long timelimit; unsigned long deadline;
+#endif
+};
+#endif
+
 /* 
 	Layer 0 functions 
 
@@ -610,87 +1000,98 @@ File ofile;
 */
 
 // heap management 
-address_t bmalloc(signed char, char, char, short);
-address_t bfind(signed char, char, char);
-address_t blength (signed char, char, char);
-void clrvars();
+LIBLOCAL address_t bmalloc(signed char, char, char, address_t, char);
+LIBLOCAL address_t bfind(signed char, char, char);
+LIBLOCAL address_t blength (signed char, char, char);
+LIBLOCAL void heapindexinit();
+LIBLOCAL void heapindexclear();
+LIBLOCAL address_t heapindexfind(signed char, char, char);
+LIBLOCAL void clrvars();
 
 // normal variables
-void  createvar(char, char);
-number_t getvar(char, char);
-void  setvar(char, char, number_t);
+LIBLOCAL void  createvar(char, char);
+LIBLOCAL number_t getvar(char, char);
+LIBLOCAL void  setvar(char, char, number_t);
+LIBLOCAL void varindexclear();
+LIBLOCAL address_t varresolve(address_t, char, char);
+LIBLOCAL number_t getvarat(address_t, char, char);
+LIBLOCAL void setvarat(address_t, char, char, number_t);
 
 // low level memory access packing n*8bit bit into n 8 bit objects
 // e* is for Arduino EEPROM
-void  getnumber(address_t, short);
-void  setnumber(address_t, short);
-void  egetnumber(address_t, short);
-void  esetnumber(address_t, short);
+LIBLOCAL void  getnumber(address_t, short);
+LIBLOCAL void  setnumber(address_t, short);
+LIBLOCAL void  egetnumber(address_t, short);
+LIBLOCAL void  esetnumber(address_t, short);
 
 // array handling
-void  createarray(char, char, address_t);
-void  array(char, char, char, address_t, number_t*);
+LIBLOCAL void  createarray(char, char, short);
+LIBLOCAL void  array(char, char, char, address_t, number_t*);
 
 // string handling 
-void  createstring(char, char, address_t);
-char* getstring(char, char, address_t);
-void  setstring(char, char, address_t, char *, address_t);
+LIBLOCAL void  createstring(char, char, address_t);
+LIBLOCAL char* getstring(char, char, address_t);
+LIBLOCAL void  setstring(char, char, address_t, char *, address_t);
 
 // access memory dimensions and for strings also the actual length
-number_t arraydim(char, char);
-number_t stringdim(char, char);
-number_t lenstring(char, char);
-void setstringlength(char, char, address_t);
+LIBLOCAL number_t arraydim(char, char);
+LIBLOCAL number_t stringdim(char, char);
+LIBLOCAL number_t lenstring(char, char);
+LIBLOCAL void setstringlength(char, char, address_t);
 
 // get keyword from PROGMEM
-char* getkeyword(signed char);
-char* getmessage(char);
-void printmessage(char);
+LIBLOCAL char* getkeyword(signed char);
+LIBLOCAL void keywordindexinit();
+LIBLOCAL char* getmessage(char);
+LIBLOCAL void printmessage(char);
 
 // error handling
-void error(signed char);
-void reseterror();
-void debugtoken();
-void debug(char*);
+LIBLOCAL void error(signed char);
+LIBLOCAL void reseterror();
+LIBLOCAL void debugtoken();
+LIBLOCAL void debug(char*);
 
 // stack stuff
-void push(number_t);
-number_t pop();
+LIBLOCAL void push(number_t);
+LIBLOCAL number_t pop();
 void drop();
-void clearst();
+LIBLOCAL void clearst();
+LIBLOCAL void stackinit();
+LIBLOCAL void stackresize(char, address_t);
 
 // generic display code - used for Shield, I2C, and TFT
-void dspwrite(char);
-void dspbegin();
-char dspwaitonscroll();
-char dspactive();
-void dspsetscrollmode(char, short);
-void dspsetcursor(short, short);
+LIBLOCAL void dspwrite(char);
+LIBLOCAL void dspbegin();
+LIBLOCAL char dspwaitonscroll();
+LIBLOCAL char dspactive();
+LIBLOCAL void dspsetscrollmode(char, short);
+LIBLOCAL void dspsetcursor(short, short);
 
 // input output
 // these are the platfrom depended lowlevel functions
-void serialbegin();
-void prtbegin();
-void ioinit();
-void iodefaults();
+LIBLOCAL void serialbegin();
+LIBLOCAL void prtbegin();
+LIBLOCAL void ioinit();
+LIBLOCAL void iodefaults();
 void picogetchar(int);
-void outch(char);
-char inch();
-char checkch();
-void ins(char*, short); 
+LIBLOCAL void outch(char);
+LIBLOCAL void outflush();
+LIBLOCAL char inch();
+LIBLOCAL char checkch();
+LIBLOCAL void ins(char*, short); 
 
 // from here on the functions only use the functions above
 // there should be no platform depended code here
-void outcr();
-void outspc();
-void outs(char*, short);
-void outsc(char*);
-void outscf(char *, short);
-char innumber(number_t*);
-short parsenumber(char*, number_t*);
+LIBLOCAL void outcr();
+LIBLOCAL void outspc();
+LIBLOCAL void outs(char*, short);
+LIBLOCAL void outsc(char*);
+LIBLOCAL void outscf(char *, short);
+LIBLOCAL char innumber(number_t*);
+LIBLOCAL short parsenumber(char*, number_t*);
 short parsenumber2(char*, number_t*);
-void outnumber(number_t);
-short writenumber(char*, number_t);
+LIBLOCAL void outnumber(number_t);
+LIBLOCAL short writenumber(char*, number_t);
 short writenumber2(char*, number_t);
 
 /*
@@ -701,11 +1102,11 @@ short writenumber2(char*, number_t);
 
 // EEPROM 
 #if defined(ARDUINO) && defined(ARDUINOEEPROM)
-address_t elength() { return EEPROM.length(); }
-void eupdate(address_t i, short c) { EEPROM.update(i, c); }
-short eread(address_t i) { return (signed char) EEPROM.read(i); }
+LIBLOCAL address_t elength() { return EEPROM.length(); }
+LIBLOCAL void eupdate(address_t i, short c) { EEPROM.update(i, c); }
+LIBLOCAL short eread(address_t i) { return (signed char) EEPROM.read(i); }
 // save a file to EEPROM
-void esave() {
+LIBLOCAL void esave() {
 	address_t a=0;
 	if (top+eheadersize < elength()) {
 		a=0;
@@ -728,7 +1129,7 @@ void esave() {
 }
 
 // load a file from EEPROM
-void eload() {
+LIBLOCAL void eload() {
 	address_t a=0;
 	if (eread(a) == 0 || eread(a) == 1) { // have we stored a program
 		a++;
@@ -742,16 +1143,37 @@ void eload() {
 			mem[a-eheadersize]=eread(a);
 			a++;
 		}
+#ifdef HASLINEINDEX
+		lineindexvalid=FALSE;
+#endif
+#ifdef HASCOMPILER
+		cvalid=FALSE;
+#endif
+#ifdef HASFORINDEX
+		forindexvalid=FALSE;
+#endif
+#ifdef HASVARINDEX
+		varindexvalid=FALSE;
+#endif
+#ifdef HASFUSE
+		fuseindexvalid=FALSE;
+#endif
+#ifdef HASFOLD
+		foldindexvalid=FALSE;
+#endif
+#ifdef HASSHORTCIRCUIT
+		skipindexvalid=FALSE;
+#endif
 	} else { // no valid program data is stored 
 		error(EEEPROM);
 	}
 }
 #else
-address_t elength() { return 0; }
-void eupdate(address_t i, short c) { return; }
-short eread(address_t i) { return 0; }
-void esave() { error(EEEPROM); return; }
-void eload() { error(EEEPROM); return; }
+LIBLOCAL address_t elength() { return 0; }
+LIBLOCAL void eupdate(address_t i, short c) { return; }
+LIBLOCAL short eread(address_t i) { return 0; }
+LIBLOCAL void esave() { error(EEEPROM); return; }
+LIBLOCAL void eload() { error(EEEPROM); return; }
 #endif
 
 // global variables for the keyboard
@@ -773,7 +1195,7 @@ PS2Keyboard keyboard;
 #ifdef ESP8266
 const int PS2DataPin = 0;
 const int PS2IRQpin =  2;
-PS2Kbd keyboard(PS2DataPin, PS2IRQpin);
+LIBLOCAL PS2Kbd keyboard(PS2DataPin, PS2IRQpin);
 #else
 const int PS2DataPin = 3;
 const int PS2IRQpin =  2;
@@ -789,9 +1211,9 @@ PS2Keyboard keyboard;
 // LCD shield pins to Arduino
 //  RS, EN, d4, d5, d6, d7; 
 // backlight on pin 10;
-const int dsp_rows=2;
-const int dsp_columns=16;
-LiquidCrystal lcd( 8,  9,  4,  5,  6,  7);
+LIBLOCAL const int dsp_rows=2;
+LIBLOCAL const int dsp_columns=16;
+LIBLOCAL LiquidCrystal lcd( 8,  9,  4,  5,  6,  7);
 void dspbegin() { 	lcd.begin(dsp_columns, dsp_rows); dspsetscrollmode(1, 1);  }
 void dspprintchar(char c, short col, short row) { lcd.setCursor(col, row); lcd.write(c);}
 void dspclear() { lcd.clear(); }
@@ -803,9 +1225,9 @@ void dspclear() { lcd.clear(); }
 #define DISPLAYDRIVER
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
-const int dsp_rows=4;
-const int dsp_columns=20;
-LiquidCrystal_I2C lcd(0x27, dsp_columns, dsp_rows);
+LIBLOCAL const int dsp_rows=4;
+LIBLOCAL const int dsp_columns=20;
+LIBLOCAL LiquidCrystal_I2C lcd(0x27, dsp_columns, dsp_rows);
 void dspbegin() {   lcd.init(); lcd.backlight(); dspsetscrollmode(1, 1); }
 void dspprintchar(char c, short col, short row) { lcd.setCursor(col, row); lcd.write(c);}
 void dspclear() { lcd.clear(); }
@@ -824,12 +1246,12 @@ void dspclear() { lcd.clear(); }
 extern uint8_t SmallFont[];
 extern uint8_t BigFont[];
 #ifdef ARDUINODUE
-UTFT tft(CTE70,25,26,27,28);
+LIBLOCAL UTFT tft(CTE70,25,26,27,28);
 #else 
-UTFT tft(CTE70,38,39,40,41);
+LIBLOCAL UTFT tft(CTE70,38,39,40,41);
 #endif
-const int dsp_rows=30;
-const int dsp_columns=50;
+LIBLOCAL const int dsp_rows=30;
+LIBLOCAL const int dsp_columns=50;
 char dspfontsize = 16;
 void dspbegin() { tft.InitLCD(); tft.setFont(BigFont); tft.clrScr(); dspsetscrollmode(1, 4); }
 void dspprintchar(char c, short col, short row) { tft.printChar(c, col*dspfontsize, row*dspfontsize); }
@@ -857,28 +1279,28 @@ const char eth_chipselect = 10;
 // also, this would be the place to insert the Wiring code
 // for raspberry
 #ifdef ARDUINO
-void aread(){ push(analogRead(pop())); }
-void dread(){ push(digitalRead(pop())); }
-void awrite(number_t p, number_t v){
+LIBLOCAL void aread(){ push(analogRead(pop())); }
+LIBLOCAL void dread(){ push(digitalRead(pop())); }
+LIBLOCAL void awrite(number_t p, number_t v){
 	if (v >= 0 && v<256) analogWrite(p, v);
 	else error(ERANGE);
 }
-void dwrite(number_t p, number_t v){
+LIBLOCAL void dwrite(number_t p, number_t v){
 	if (v == 0) digitalWrite(p, LOW);
 	else if (v == 1) digitalWrite(p, HIGH);
 	else error(ERANGE);
 }
-void pinm(number_t p, number_t m){
+LIBLOCAL void pinm(number_t p, number_t m){
 	if (m>=0 && m<=2)  pinMode(p, m);
 	else error(ERANGE); 
 }
-void bmillis() {
+LIBLOCAL void bmillis() {
 	number_t m;
 	// millis is processed as integer and is cyclic mod maxnumber and not cast to float!!
 	m=(number_t) (millis()/(unsigned long)pop() % (unsigned long)maxnum);
 	push(m); 
 };
-void bpulsein() { 
+LIBLOCAL void bpulsein() { 
   unsigned long t, pt;
   t=((unsigned long) pop())*1000;
   y=pop(); 
@@ -887,14 +1309,14 @@ void bpulsein() {
   push(pt);
 }
 #else
-void aread(){ return; }
-void dread(){ return; }
-void awrite(number_t p, number_t v){}
-void dwrite(number_t p, number_t v){}
-void pinm(number_t p, number_t m){}
-void delay(number_t t) {}
-struct timespec start_time;
-void bmillis() {
+LIBLOCAL void aread(){ return; }
+LIBLOCAL void dread(){ return; }
+LIBLOCAL void awrite(number_t p, number_t v){}
+LIBLOCAL void dwrite(number_t p, number_t v){}
+LIBLOCAL void pinm(number_t p, number_t m){}
+LIBLOCAL void delay(number_t t) {}
+LIBLOCAL struct timespec start_time;
+LIBLOCAL void bmillis() {
 #ifndef MINGW
 	struct timespec ts;
 	unsigned long dt;
@@ -908,7 +1330,16 @@ void bmillis() {
 	push(0);
 #endif
 };
-void bpulsein() { pop(); pop(); pop(); push(0); }
+LIBLOCAL unsigned long micros() {
+#ifndef MINGW
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec*1000000+ts.tv_nsec/1000;
+#else
+	return 0;
+#endif
+}
+LIBLOCAL void bpulsein() { pop(); pop(); pop(); push(0); }
 #endif
 
 /* 	
@@ -917,52 +1348,124 @@ void bpulsein() { pop(); pop(); pop(); push(0); }
 */
 
 // lexical analysis
-void whitespaces();
-void debugtoken();
-void nexttoken();
+LIBLOCAL void whitespaces();
+LIBLOCAL void debugtoken();
+LIBLOCAL void nexttoken();
 
 // storeing and retrieving programs
-char nomemory(number_t);
-void dumpmem(address_t, address_t);
-void storetoken(); 
-char memread(address_t);
-void gettoken();
-void firstline();
-void nextline();
-void findline(address_t);
-address_t myline(address_t);
-void moveblock(address_t, address_t, address_t);
-void zeroblock(address_t, address_t);
-void diag();
-void storeline();
+LIBLOCAL char nomemory(number_t);
+LIBLOCAL void dumpmem(address_t, address_t);
+LIBLOCAL void storetoken(); 
+LIBLOCAL char memread(address_t);
+LIBLOCAL void gettoken();
+LIBLOCAL address_t tokenlength(address_t);
+LIBLOCAL void firstline();
+LIBLOCAL void nextline();
+LIBLOCAL void skipline();
+LIBLOCAL void findline(address_t);
+LIBLOCAL address_t myline(address_t);
+LIBLOCAL void lineindexinit();
+LIBLOCAL void lineindexclear();
+LIBLOCAL void lineindexbuild();
+LIBLOCAL address_t lineindexfind(address_t);
+LIBLOCAL void lineindexupdate(address_t, address_t);
+LIBLOCAL void moveblock(address_t, address_t, address_t);
+LIBLOCAL void zeroblock(address_t, address_t);
+LIBLOCAL void diag();
+LIBLOCAL void storeline();
+LIBLOCAL void editline();
+
+// the compiler and the code runner
+LIBLOCAL void ccompile();
+LIBLOCAL void cstatement();
+LIBLOCAL void cassignment();
+LIBLOCAL void cgoto();
+LIBLOCAL void cif();
+LIBLOCAL void cfor();
+LIBLOCAL void cnextloop();
+LIBLOCAL void cexpression();
+LIBLOCAL void candexpression();
+LIBLOCAL void cnotexpression();
+LIBLOCAL void ccompexpression();
+LIBLOCAL void caddexpression();
+LIBLOCAL void cterm();
+LIBLOCAL void cfactor();
+LIBLOCAL void cfunction(void (*)(), short);
+LIBLOCAL short carguments();
+LIBLOCAL short csubscripts();
+LIBLOCAL void cnext();
+LIBLOCAL void cemit(signed char, number_t);
+LIBLOCAL void cstack(short);
+LIBLOCAL void cresolve();
+LIBLOCAL void clink();
+LIBLOCAL address_t cfind(address_t);
+LIBLOCAL address_t clinefind(address_t);
+LIBLOCAL address_t cposition();
+LIBLOCAL void crun(address_t);
 
 // read arguments from the token stream.
-char  termsymbol();
-void  parsesubstring();
-short parsesubscripts();
-void  parsenarguments(char);
-short parsearguments();
+LIBLOCAL char  termsymbol();
+LIBLOCAL void  parsesubstring();
+LIBLOCAL short parsesubscripts();
+LIBLOCAL void popsubscripts(short, char, char, address_t*);
+LIBLOCAL void  parsenarguments(char);
+LIBLOCAL short parsearguments();
 
 // mathematics and other functions
-void rnd();
-void sqr();
+LIBLOCAL void rnd();
+LIBLOCAL void sqr();
 void fre();
-void peek();
-void xabs();
-void xsgn();
+LIBLOCAL void peek();
+LIBLOCAL void xabs();
+LIBLOCAL void xsgn();
 
 // string values
-char stringvalue();
-void streval();
+LIBLOCAL char stringvalue();
+LIBLOCAL void streval();
 
 // expression evaluation 
-void factor();
-void term();
-void addexpression();
-void compexpression();
-void notexpression();
-void andexpression();
-void expression();
+LIBLOCAL void factor();
+LIBLOCAL void term();
+LIBLOCAL void addexpression();
+LIBLOCAL void compexpression();
+LIBLOCAL void notexpression();
+LIBLOCAL void andexpression();
+LIBLOCAL void expression();
+
+// short circuit AND and OR
+#ifdef HASSHORTCIRCUIT
+LIBLOCAL void skipindexinit();
+LIBLOCAL void skipindexclear();
+LIBLOCAL address_t skipindexfind(address_t);
+LIBLOCAL address_t skipend(address_t);
+LIBLOCAL char skipoperand();
+#endif
+
+// the one loop evaluator
+#ifdef HASPRATT
+LIBLOCAL char prattpower(signed char);
+LIBLOCAL void prattreduce(signed char);
+LIBLOCAL void prattexpression();
+#endif
+
+// constant folding
+#ifdef HASFOLD
+LIBLOCAL char foldfactor(address_t*, number_t*);
+LIBLOCAL char foldterm(address_t*, number_t*);
+LIBLOCAL char foldsum(address_t*, number_t*);
+#ifndef HASFLOAT
+LIBLOCAL char foldproduct(address_t*, number_t*);
+#endif
+LIBLOCAL char foldtermend(address_t);
+LIBLOCAL char foldend(address_t);
+LIBLOCAL char foldoperator(char);
+LIBLOCAL char foldlonger(address_t, address_t);
+LIBLOCAL void foldindexbuild();
+LIBLOCAL address_t foldindexfind(address_t);
+LIBLOCAL char foldat(address_t, char);
+LIBLOCAL char foldtoken(char);
+LIBLOCAL char foldnext(char);
+#endif
 
 /* 
 	Layer 2 - statements call Layer 1 functions and 
@@ -970,77 +1473,138 @@ void expression();
 */
 
 // basic commands of the core language set
-void xprint();
-void assignment();
-void lefthandside(address_t*, char*);
-void assignnumber(signed char, char, char, address_t, char);
-void xinput();
-void xgoto();
-void xreturn();
-void xif();
+LIBLOCAL void xprint();
+LIBLOCAL void assignment();
+LIBLOCAL void lefthandside(address_t*, char*);
+LIBLOCAL void assignnumber(signed char, char, char, address_t, char);
+LIBLOCAL void xinput();
+LIBLOCAL void xgoto();
+LIBLOCAL void gotoline(signed char, number_t);
+LIBLOCAL void xreturn();
+LIBLOCAL void xif();
+LIBLOCAL void xthen();
+
+// superinstructions
+#ifdef HASFUSE
+LIBLOCAL void fuseindexclear();
+LIBLOCAL address_t fuseoperand(address_t);
+LIBLOCAL char fuseterm(address_t);
+LIBLOCAL number_t fusevalue(address_t);
+LIBLOCAL signed char fusematch(address_t);
+LIBLOCAL char fusestatement();
+#endif
 
 // optional FOR NEXT loops
 #ifdef HASFORNEXT
-void findnext();
-void xfor();
-void xnext();
-void xbreak();
-void pushforstack();
-void popforstack();
-void dropforstack();
-void clrforstack();
+LIBLOCAL void findnext();
+LIBLOCAL void forindexinit();
+LIBLOCAL void forindexclear();
+LIBLOCAL address_t forindexfind(address_t);
+LIBLOCAL void xfor();
+LIBLOCAL void xnext();
+LIBLOCAL void xbreak();
+LIBLOCAL void pushforstack();
+LIBLOCAL void popforstack();
+LIBLOCAL void dropforstack();
+LIBLOCAL void clrforstack();
 #endif
 
 // optional GOSUB commands
 #ifdef HASGOSUB
-void xreturn();
-void pushgosubstack();
-void popgosubstack();
-void dropgosubstack();
-void clrgosubstack();
+LIBLOCAL void xreturn();
+LIBLOCAL void pushgosubstack();
+LIBLOCAL void popgosubstack();
+LIBLOCAL void dropgosubstack();
+LIBLOCAL void clrgosubstack();
 #endif
 
 // control commands and misc
-void outputtoken();
-void xlist();
-void xrun();
-void xnew();
-void xrem();
-void xclr();
-void xdim();
-void xpoke();
-void xtab();
-void xdump();
+LIBLOCAL void outputtoken();
+LIBLOCAL void xlist();
+LIBLOCAL void xrun();
+LIBLOCAL void xnew();
+LIBLOCAL void xrem();
+LIBLOCAL void xclr();
+LIBLOCAL void xdim();
+LIBLOCAL void xpoke();
+LIBLOCAL void xtab();
+LIBLOCAL void xdump();
 
 // file access 
 void stringtosbuffer();
 char* getfilename();
-void getfilename2(char*, char);
-void xsave();
-void xload();
-void xcatalog();
-void xdelete();
-void xopen();
-void xclose();
+LIBLOCAL void getfilename2(char*, char);
+LIBLOCAL void xsave();
+LIBLOCAL void xload();
+LIBLOCAL void xcatalog();
+LIBLOCAL void xdelete();
+LIBLOCAL void xopen();
+LIBLOCAL void xclose();
 
 // low level I/O in BASIC
-void xget();
-void xput();
-void xset();
+LIBLOCAL void xget();
+LIBLOCAL void xput();
+LIBLOCAL void xset();
 
 // Arduino IO control
-void xdwrite();
-void xawrite();
-void xpinm();
-void xdelay();
-void xtone();
+LIBLOCAL void xdwrite();
+LIBLOCAL void xawrite();
+LIBLOCAL void xpinm();
+LIBLOCAL void xdelay();
+LIBLOCAL void xtone();
 
 // low level access functions
-void xcall();
-void xusr();
+LIBLOCAL void xcall();
+LIBLOCAL void xusr();
+
+// the profiler
+LIBLOCAL void profileclear();
+LIBLOCAL address_t profileslotof(address_t);
+LIBLOCAL address_t profilefind(address_t);
+LIBLOCAL void profilestatement();
+LIBLOCAL void profilestop();
+LIBLOCAL void xprofile();
+
+// whole array operations
+LIBLOCAL address_t arraypayload(char, char, address_t*);
+LIBLOCAL void xfill();
+LIBLOCAL void xcopy();
+LIBLOCAL void arrayfunction(signed char);
 
 // the statement loop
-void statement();
+LIBLOCAL void statement();
+
+// the state shared by all interpreters
+void basicinit();
+
+// the interpreter contexts
+#ifdef HASCONTEXT
+LIBLOCAL void contextswap(struct basiccontext*);
+struct basiccontext* basiccreate(unsigned long);
+void basicdestroy(struct basiccontext*);
+signed char basicrun(struct basiccontext*, char*);
+void basicsink(struct basiccontext*, void (*)(char, void*), void*);
+void basicinput(struct basiccontext*, const char*, long);
+void basicload(struct basiccontext*, const char*, long);
+int basicexec(struct basiccontext*, unsigned long);
+void basiclimit(struct basiccontext*, unsigned long, unsigned long);
+int basicresume(struct basiccontext*);
+LIBLOCAL char consoleread();
+#endif
+
+// the statement budget
+#ifdef HASBUDGET
+LIBLOCAL void budgetstart();
+LIBLOCAL char budgetcheck();
+#endif
+
+// the batch runner
+#ifdef HASBATCH
+LIBLOCAL void bwrite(char, void*);
+LIBLOCAL char* readfile(char*, long*);
+LIBLOCAL void batchjob(char*, char*, char*);
+LIBLOCAL void batch(char**, int, int);
+#endif
 
 /* 
  	Layer 0
@@ -1309,8 +1873,8 @@ void dspwrite(char c){
 void dspsetscrollmode(char c, short l) {}
 #endif
 #else
-const int dsp_rows=0;
-const int dsp_columns=0;
+LIBLOCAL const int dsp_rows=0;
+LIBLOCAL const int dsp_columns=0;
 void dspwrite(char c){};
 void dspbegin() {};
 char dspwaitonscroll() { return 0; };
@@ -1336,13 +1900,19 @@ void dspsetcursor(short c, short r) {}
  */
 
 #if MEMSIZE == 0
-// guess the possible basic memory size
-void allocmem() {
+// guess the possible basic memory size or use the size 
+// requested on the command line
+LIBLOCAL void allocmem() {
 
 	short i = 0;
 	// 									RP2040  ESP    MK   MEGA   UNO  168  FALLBACK
 	const unsigned short memmodel[7] = {60000, 46000, 28000, 4096, 1024, 512, 128}; 
 
+	if (memrequest > 0) {
+		mem=(signed char*)malloc(memrequest);
+		if (mem != NULL) { memsize=memrequest-1; return; }
+	}
+
 	if (sizeof(number_t) <= 2) i=2;
 	do {
 		mem=(signed char*)malloc(memmodel[i]);
@@ -1357,10 +1927,12 @@ void allocmem() {
 // allocate a junk of memory for a variable on the heap
 // every objects is identified by name (c,d) and type t
 // 3 bytes are used here but 2 would be enough
+// n is the number of dimensions of an array
 
-address_t bmalloc(signed char t, char c, char d, short l) {
+address_t bmalloc(signed char t, char c, char d, address_t l, char n) {
 
 	address_t vsize;     // the length of the header
+	address_t a;         // the address of the payload
 	address_t b;
 
 
@@ -1377,17 +1949,20 @@ address_t bmalloc(signed char t, char c, char d, short l) {
 		how much space is needed
 			3 bytes for the token and the 2 name characters
 			numsize for every number including array length
+			one byte for the number of dimensions of an array 
+			and addrsize for each of its extents
 			one byte for every string character
 	*/
 
 	if ( t == VARIABLE ) vsize=numsize+3; 	
+#ifdef HASMULTIDIM
+	else if ( t == ARRAYVAR ) vsize=numsize*l+(n+1)*addrsize+4;
+#else
 	else if ( t == ARRAYVAR ) vsize=numsize*l+addrsize+3;
+#endif
 	else vsize=l+addrsize+3;
 	if ( (himem - top) < vsize) { error(EOUTOFMEMORY); return 0;}
 
-	// here we would create the hash, currently simplified
-	// the hash is the first digit of the variable plus the token
-
 	// write the header - inefficient - 3 bytes for a hash
 	b=himem;
 	mem[b--]=c;
@@ -1399,16 +1974,39 @@ address_t bmalloc(signed char t, char c, char d, short l) {
 
 		// store the maximum length of the array of string
 		b=b-addrsize+1;
-		z.a=vsize-(addrsize+3);
+		if (t == ARRAYVAR) z.a=numsize*l; else z.a=l;
 		setnumber(b, addrsize);
 		b--;
 	}
 
+#ifdef HASMULTIDIM
+	// the number of dimensions is right above the payload and the 
+	// extents are below it, createarray() writes them
+	if (t == ARRAYVAR) mem[b--]=n;
+#endif
+
 	// reserve space for the payload
 	himem-=vsize;
 	nvars++;
+	a=himem+1;
+#ifdef HASMULTIDIM
+	if (t == ARRAYVAR) a+=n*addrsize;
+#endif
+
+	// and remember the object in the hash index
+#ifdef HASHEAPINDEX
+	if (heapindexsize && (b=heapindexfind(t, c, d)) != heapindexsize) {
+		heapindex[b].t=t;
+		heapindex[b].c=c;
+		heapindex[b].d=d;
+		heapindex[b].a=a;
+		if (t == VARIABLE) heapindex[b].l=numsize; 
+		else if (t == ARRAYVAR) heapindex[b].l=numsize*l; 
+		else heapindex[b].l=l;
+	}
+#endif
 
-	return himem+1;
+	return a;
 }
 
 
@@ -1420,6 +2018,18 @@ address_t bfind(signed char t, char c, char d) {
 	signed char t1;
 	char c1, d1;
 	short i=0;
+#ifdef HASMULTIDIM
+	char n;
+#endif
+
+#ifdef HASHEAPINDEX
+	if (heapindexsize && (b=heapindexfind(t, c, d)) != heapindexsize) {
+		if (heapindex[b].a == 0) return 0;
+		z.a=heapindex[b].l;
+		return heapindex[b].a;
+	}
+	b=memsize;
+#endif
 
 	while (i < nvars) { 
 
@@ -1433,11 +2043,17 @@ address_t bfind(signed char t, char c, char d) {
 			b=b-addrsize+1;
 			getnumber(b, addrsize);
 			b--;
+#ifdef HASMULTIDIM
+			if (t1 == ARRAYVAR) n=mem[b--];
+#endif
 		}
 
 		b-=z.a;
 
 		if (c1 == c && d1 == d && t1 == t) return b+1;
+#ifdef HASMULTIDIM
+		if (t1 == ARRAYVAR) b-=n*addrsize;
+#endif
 		i++;
 	}
 
@@ -1452,6 +2068,54 @@ address_t blength (signed char t, char c, char d) {
 }
 #endif
 
+/*
+	The heap index is an open addressed hash table of the objects 
+	on the heap keyed by type and name. It stores the address and 
+	the length bfind() would find. bmalloc() adds objects, clrvars() 
+	and xnew() empty it. The heap layout is not changed by it. 
+	The table has room for twice the number of the smallest 
+	objects that fit into memory, up to 8192 slots. Names made 
+	with @$ can fill it, objects that find no slot are found by 
+	the linear search of bfind().
+*/
+
+#ifdef HASHEAPINDEX
+void heapindexinit() {
+	address_t n=(memsize+1)/(addrsize+3);
+
+	// a bigger table would cost more than it saves
+	if (n > 4096) n=4096;
+
+	heapindexsize=1;
+	while (heapindexsize/2 < n) heapindexsize*=2;
+	heapindex=malloc(heapindexsize*sizeof(*heapindex));
+	if (heapindex == NULL) { heapindexsize=0; return; }
+	for (n=0; n<heapindexsize; n++) heapindex[n].a=0;
+}
+
+// only needed if there are objects
+void heapindexclear() {
+	address_t i;
+
+	if (nvars == 0) return;
+	for (i=0; i<heapindexsize; i++) heapindex[i].a=0;
+}
+
+// the slot of an object or the free slot where it belongs, 
+// heapindexsize if the table is full and the object not in it
+address_t heapindexfind(signed char t, char c, char d) {
+	address_t i, n;
+
+	i=((unsigned char)c*97+(unsigned char)d*7+(unsigned char)t) & (heapindexsize-1);
+	for (n=0; n<heapindexsize; n++) {
+		if (heapindex[i].a == 0) return i;
+		if (heapindex[i].c == c && heapindex[i].d == d && heapindex[i].t == t) return i;
+		i=(i+1) & (heapindexsize-1);
+	}
+	return heapindexsize;
+}
+#endif
+
 
 // ununsed so far, simple variables are created on the fly
 void createvar(char c, char d){
@@ -1493,7 +2157,7 @@ number_t getvar(char c, char d){
 	// dynamically allocated vars
 	a=bfind(VARIABLE, c, d);
 	if ( a == 0) {
-		a=bmalloc(VARIABLE, c, d, 0);
+		a=bmalloc(VARIABLE, c, d, 0, 0);
 		if (er != 0) return 0;
 	} 
 
@@ -1549,7 +2213,7 @@ void setvar(char c, char d, number_t v){
 	// dynamically allocated vars
 	a=bfind(VARIABLE, c, d);
 	if ( a == 0) {
-		a=bmalloc(VARIABLE, c, d, 0);
+		a=bmalloc(VARIABLE, c, d, 0, 0);
 		if (er != 0) return;
 	} 
 
@@ -1560,9 +2224,81 @@ void setvar(char c, char d, number_t v){
 #endif
 }
 
+/*
+	The var index resolves the variables of a running program 
+	once. For every position of a heap variable token it stores 
+	the address of the variable, later reads and writes are one 
+	table lookup. The table is as long as the program and emptied 
+	on the next use after CLR, NEW, RUN or a change of the program. 
+	Objects on the heap never move, DIM only adds new ones.
+	The static variables A-Z and the specials are not cached.
+*/
+
+#ifdef HASVARINDEX
+void varindexclear() {
+	address_t i;
+
+	if (varindexsize < top) {
+		free(varindex);
+		varindexsize=top;
+		varindex=malloc(varindexsize*sizeof(address_t));
+		if (varindex == NULL) varindexsize=0;
+	}
+	for (i=0; i<varindexsize; i++) varindex[i]=0;
+	varindexvalid=TRUE;
+}
+
+// the heap address of the variable whose token is at p
+address_t varresolve(address_t p, char c, char d) {
+	address_t a;
+
+	if (!varindexvalid) varindexclear();
+	if (p < varindexsize && varindex[p]) {
+		varindexhits++;
+		return varindex[p];
+	}
+	varindexmisses++;
+
+	a=bfind(VARIABLE, c, d);
+	if (a == 0) {
+		a=bmalloc(VARIABLE, c, d, 0, 0);
+		if (er != 0) return 0;
+	}
+	if (p < varindexsize) varindex[p]=a;
+	return a;
+}
+
+// getvar and setvar for a variable token at p of a running program
+number_t getvarat(address_t p, char c, char d) {
+	address_t a;
+
+	if (st != SRUN || c == '@' || (c >= 65 && c <= 91 && d == 0)) return getvar(c, d);
+	a=varresolve(p, c, d);
+	if (er != 0) return 0;
+	getnumber(a, numsize);
+	return z.i;
+}
+
+void setvarat(address_t p, char c, char d, number_t v) {
+	address_t a;
+
+	if (st != SRUN || c == '@' || (c >= 65 && c <= 91 && d == 0)) { setvar(c, d, v); return; }
+	a=varresolve(p, c, d);
+	if (er != 0) return;
+	z.i=v;
+	setnumber(a, numsize);
+}
+#endif
+
 // clr all variables 
 void clrvars() {
 	for (char i=0; i<VARSIZE; i++) vars[i]=0;
+#ifdef HASHEAPINDEX
+	heapindexclear();
+#endif
+#ifdef HASVARINDEX
+	varindexvalid=FALSE;
+#endif
 	nvars=0;
 	himem=memsize;
 }
@@ -1637,13 +2373,36 @@ void esetnumber(address_t m, short n){
 }
 
 
-void createarray(char c, char d, address_t i) {
+// the n extents of the array are on the stack, the last one on top
+void createarray(char c, char d, short n) {
+	address_t l=1;
+	short k;
+#ifdef HASMULTIDIM
+	address_t a;
+#endif
+
+	for (k=1; k<=n; k++) {
+		if (stack[sp-k] <= 0) { error(ERANGE); return; }
+		if (stack[sp-k] > memsize/numsize/l) { error(EOUTOFMEMORY); return; }
+		l*=stack[sp-k];
+	}
 #ifdef HASAPPLE1
 	if (bfind(ARRAYVAR, c, d)) { error(EVARIABLE); return; }
-	(void) bmalloc(ARRAYVAR, c, d, i);
+#ifndef HASMULTIDIM
+	(void) bmalloc(ARRAYVAR, c, d, l, n);
+	if (er != 0) return;
+#else
+	a=bmalloc(ARRAYVAR, c, d, l, n);
 	if (er != 0) return;
+	// the extents are below the payload, the last one right below it
+	for (k=1; k<=n; k++) {
+		z.a=stack[sp-k];
+		setnumber(a-k*addrsize, addrsize);
+	}
+#endif
 	if (DEBUG) { outsc("* created array "); outch(c); outspc(); outnumber(nvars); outcr(); }
 #endif
+	sp-=n;
 }
 
 // generic array access function 
@@ -1732,7 +2491,7 @@ void array(char m, char c, char d, address_t i, number_t* v) {
 void createstring(char c, char d, address_t i) {
 #ifdef HASAPPLE1
 	if (bfind(STRINGVAR, c, d)) { error(EVARIABLE); return; }
-	(void) bmalloc(STRINGVAR, c, d, i+strindexsize);
+	(void) bmalloc(STRINGVAR, c, d, i+strindexsize, 0);
 	if (er != 0) return;
 	if (DEBUG) { outsc("Created string "); outch(c); outch(d); outspc(); outnumber(nvars); outcr(); }
 #endif
@@ -1892,6 +2651,21 @@ char* getkeyword(signed char t) {
 #endif
 }
 
+// chain the keywords by their first character, all start between < and Z
+#ifdef HASKEYWORDINDEX
+void keywordindexinit() {
+	signed char t;
+	short c;
+
+	for (c=0; c<'Z'-'<'+1; c++) keywordfirst[c]=0;
+	for (t=BASEKEYWORD+NKEYWORDS-1; t >= BASEKEYWORD; t--) {
+		c=*getkeyword(t)-'<';
+		keywordnext[t-BASEKEYWORD]=keywordfirst[c];
+		keywordfirst[c]=t;
+	}
+}
+#endif
+
 char* getmessage(char i) {
 
 	if (i >= NKEYWORDS) return NULL;
@@ -1930,7 +2704,10 @@ void error(signed char e){
 	// set input and output device back to default
 	od=odd;
 	id=idd;
-	// find the line number
+	// find the line number, compiled code knows only its statement
+#ifdef HASCOMPILER
+	if (crunning) here=cposition();
+#endif
 	if (st != SINT) {
 		outnumber(myline(here));
 		outch(':');
@@ -2017,7 +2794,7 @@ void debug(char *c){
 
 void push(number_t t){
 	if (DEBUG) {outsc("** push sp= "); outnumber(sp); outcr(); }
-	if (sp == STACKSIZE)
+	if (sp == stacksize)
 		error(ESTACK);
 	else
 		stack[sp++]=t;
@@ -2043,6 +2820,78 @@ void drop() {
 }
 */
 
+/*
+	On the host the stacks are allocated at startup with the sizes 
+	from the command line, SET resizes them. Entries in use are 
+	kept and a failed resize leaves the old stack.
+*/
+
+#ifdef HASDYNSTACKS
+void stackinit() {
+	address_t n=stacksize;
+	short gn=0, fn=0;
+
+#ifdef HASGOSUB
+	gn=gosubdepth;
+	gosubdepth=0;
+#endif
+#ifdef HASFORNEXT
+	fn=fordepth;
+	fordepth=0;
+#endif
+	stacksize=0;
+	stackresize(0, n);
+	if (stacksize == 0) stackresize(0, STACKSIZE);
+#ifdef HASGOSUB
+	stackresize(1, gn);
+	if (gosubdepth == 0) stackresize(1, GOSUBDEPTH);
+#endif
+#ifdef HASFORNEXT
+	stackresize(2, fn);
+	if (fordepth == 0) stackresize(2, FORDEPTH);
+#endif
+}
+
+// s is 0 for the arithmetic stack, 1 for gosub and 2 for for
+void stackresize(char s, address_t n) {
+	void* p;
+
+	switch (s) {
+		case 0:
+			if (n == 0 || n < sp) break;
+			if ((p=realloc(stack, n*sizeof(*stack))) == NULL) { error(EOUTOFMEMORY); return; }
+			stack=p;
+			stacksize=n;
+			return;
+#ifdef HASGOSUB
+		case 1:
+			if (n == 0 || n < gosubsp || n > 32767) break;
+#ifdef HASCOMPILER
+			if ((p=realloc(cgosubcache, n*sizeof(*cgosubcache))) == NULL) { error(EOUTOFMEMORY); return; }
+			cgosubcache=p;
+#endif
+			if ((p=realloc(gosubstack, n*sizeof(*gosubstack))) == NULL) { error(EOUTOFMEMORY); return; }
+			gosubstack=p;
+			gosubdepth=n;
+			return;
+#endif
+#ifdef HASFORNEXT
+		case 2:
+			if (n == 0 || n < forsp || n > 32767) break;
+#ifdef HASCOMPILER
+			if ((p=realloc(cforcache, n*sizeof(*cforcache))) == NULL) { error(EOUTOFMEMORY); return; }
+			cforcache=p;
+#endif
+			if ((p=realloc(forstack, n*sizeof(*forstack))) == NULL) { error(EOUTOFMEMORY); return; }
+			forstack=p;
+			fordepth=n;
+			return;
+#endif
+	}
+	error(ERANGE);
+}
+#endif
+
 void clearst(){
 	sp=0;
 }
@@ -2055,7 +2904,7 @@ void clearst(){
 
 #ifdef HASFORNEXT
 void pushforstack(){
-	if (forsp < FORDEPTH) {
+	if (forsp < fordepth) {
 		forstack[forsp].varx=xc;
 		forstack[forsp].vary=yc;
 		forstack[forsp].here=here;
@@ -2157,7 +3006,7 @@ void iodefaults() {
 */
 
 // wrapper around file access
-void filewrite(char c) {
+LIBLOCAL void filewrite(char c) {
 #ifndef ARDUINO
 	if (ofd) fputc(c, ofd); else ert=1;
 #else
@@ -2168,7 +3017,7 @@ void filewrite(char c) {
 	return;
 }
 
-char fileread(){
+LIBLOCAL char fileread(){
 	char c;
 #ifndef ARDUINO
 	if (ifd) c=fgetc(ifd); else { ert=1; return 0; }
@@ -2183,10 +3032,20 @@ char fileread(){
 	return c;
 }
 
-// wrapper around console output
-void serialwrite(char c) {
+// wrapper around console output, buffered output is written 
+// when the buffer is full, on a newline in interactive mode 
+// and before input
+LIBLOCAL void serialwrite(char c) {
 #ifndef ARDUINO
+#ifdef HASCONTEXT
+	if (memconsole) { if (consolesink) consolesink(c, consoledata); return; }
+#endif
+#ifdef HASOUTBUFFER
+	obuffer[obi++]=c;
+	if (obi == OBUFSIZE || !obuffered || (c == '\n' && st == SINT)) outflush();
+#else
 	putchar(c);
+#endif
 #else 
 #ifndef USESPICOSERIAL
 	Serial.write(c);
@@ -2197,6 +3056,14 @@ void serialwrite(char c) {
 	return;	
 }
 
+void outflush() {
+#ifdef HASOUTBUFFER
+	if (obi > 0) fwrite(obuffer, 1, obi, stdout);
+	obi=0;
+	fflush(stdout);
+#endif
+}
+
 // printer wrappers
 void prtbegin() {
 #ifdef ARDUINOPRT
@@ -2204,7 +3071,7 @@ void prtbegin() {
 #endif
 }
 
-void prtwrite(char c) {
+LIBLOCAL void prtwrite(char c) {
 #ifdef ARDUINOPRT
 	Serial1.write(c);
 #endif
@@ -2220,8 +3087,13 @@ void serialbegin(){}
 
 char inch(){
 	char c;
-	if (id == ISERIAL)
+	if (id == ISERIAL) {
+#ifdef HASCONTEXT
+		if (memconsole) return consoleread();
+#endif
+		outflush();
 		return getchar(); 
+	}
 	if (id == IFILE) 
 		return fileread();
 	return 0;
@@ -2821,8 +3693,25 @@ void nexttoken() {
 
 	keywords are an arry of null terminated strings.
 
+	With the keyword index only the keywords starting with 
+	the first character of the word are compared.
+
 */
 
+#ifdef HASKEYWORDINDEX
+	if (*bi >= '<' && *bi <= 'Z') token=keywordfirst[*bi-'<']; else token=0;
+	while (token != 0){
+		ir=getkeyword(token);
+		xc=0;
+		while (*(ir+xc) != 0) {
+			if (*(ir+xc) != *(bi+xc)){
+				token=keywordnext[token-BASEKEYWORD];
+				xc=0;
+				break;
+			} else 
+				xc++;
+		}
+#else
 	token=BASEKEYWORD;
 	while (token < NKEYWORDS+BASEKEYWORD){
 		ir=getkeyword(token);
@@ -2835,6 +3724,7 @@ void nexttoken() {
 			} else 
 				xc++;
 		}
+#endif
 		if (xc == 0)
 			continue;
 		if ( *(bi+xc) < 'A' || *(bi+xc) > 'Z' ) {
@@ -2895,7 +3785,7 @@ void nexttoken() {
 	Layer 1 - program editor 
 
 	Editing the program, the structure of a line is 
-	LINENUMBER linenumber(2bytes) token(n bytes)
+	LINENUMBER linenumber(addrsize bytes) token(n bytes)
 
 	store* stores something to memory 
 	get* retrieves information
@@ -2983,7 +3873,13 @@ char memread(address_t i){
 
 
 // get a token from memory
+// with HASRAMTOKEN the program is always in mem, numbers and 
+// addresses are read in one piece and not byte by byte through z
 void gettoken() {
+#ifdef HASRAMTOKEN
+	address_t a;
+	signed char* p;
+#endif
 
 	// if we have reached the end of the program, EOL is always returned
 	// we don't rely on mem having a trailing EOL
@@ -2992,6 +3888,37 @@ void gettoken() {
 		return;
 	}
 
+#ifdef HASRAMTOKEN
+	p=&mem[here];
+	token=*p++;
+	switch (token) {
+		case LINENUMBER:
+			memcpy(&a, p, sizeof(address_t));
+			x=a;
+			here+=addrsize+1;
+			return;
+		case NUMBER:
+			memcpy(&x, p, sizeof(number_t));
+			here+=numsize+1;
+			return;
+		case ARRAYVAR:
+		case VARIABLE:
+		case STRINGVAR:
+			xc=p[0];
+			yc=p[1];
+			here+=3;
+			return;
+		case STRING:
+			x=(unsigned char)p[0];
+			ir=(char *)p+1;
+			here+=x+2;
+			return;
+		default:
+			here++;
+			return;
+	}
+#endif
+
 	token=memread(here++);
 	switch (token) {
 		case LINENUMBER:
@@ -3029,6 +3956,24 @@ void gettoken() {
 		}
 }
 
+// the length of the token at p of a program in memory
+address_t tokenlength(address_t p) {
+	switch (mem[p]) {
+		case LINENUMBER: 
+			return addrsize+1;
+		case NUMBER: 
+			return numsize+1;
+		case ARRAYVAR: 
+		case VARIABLE: 
+		case STRINGVAR: 
+			return 3;
+		case STRING: 
+			return (unsigned char)mem[p+1]+2;
+		default: 
+			return 1;
+	}
+}
+
 // goto the first line of a program
 void firstline() {
 	if (top == 0) {
@@ -3052,8 +3997,62 @@ void nextline() {
 	}
 }
 
+// skip the rest of the line, in a program the line index 
+// has the address of the next line
+void skipline() {
+#ifdef HASLINEINDEX
+	address_t i, j, m;
+
+	if (st == SRUN) {
+		if (!lineindexvalid) lineindexbuild();
+		if (lineindexvalid) {
+			i=lineindexlast;
+			if (i >= nlines || lineindex[i].addr >= here || (i+1 < nlines && lineindex[i+1].addr < here)) {
+				i=0;
+				j=nlines;
+				while (i < j) {
+					m=(i+j)/2;
+					if (lineindex[m].addr < here) i=m+1; else j=m;
+				}
+				if (i > 0) lineindexlast=i-1; else lineindexlast=0;
+			} else 
+				i++;
+			if (i < nlines) {
+				here=lineindex[i].addr;
+				gettoken();
+			} else {
+				here=top;
+				token=EOL;
+			}
+			return;
+		}
+	}
+#endif
+	do nexttoken();	while (token != LINENUMBER && token != EOL && here <= top);
+}
+
 // find a line
 void findline(address_t l) {
+#ifdef HASLINEINDEX
+	address_t i;
+
+	// the index only describes programs in memory
+	if (st != SERUN) {
+		if (lineindexvalid) lineindexhits++; else lineindexbuild();
+		if (lineindexvalid) {
+			i=lineindexfind(l);
+			if (i < nlines && lineindex[i].line == l) {
+				here=lineindex[i].addr+addrsize+1;
+				token=LINENUMBER;
+				x=l;
+				return;
+			}
+			error(ELINE);
+			return;
+		}
+	} else 
+		lineindexmisses++;
+#endif
 	here=0;
 	while (here < top) {
 		gettoken();
@@ -3068,6 +4067,22 @@ address_t myline(address_t h) {
 	address_t l1=0;
 	address_t here2;
 
+#ifdef HASLINEINDEX
+	address_t i, j, m;
+
+	// the last line whose line number token ends before h
+	if (st != SERUN && !lineindexvalid) lineindexbuild();
+	if (st != SERUN && lineindexvalid) {
+		i=0; 
+		j=nlines;
+		while (i < j) {
+			m=(i+j)/2;
+			if (lineindex[m].addr+addrsize+1 < h) i=m+1; else j=m;
+		}
+		if (i == 0) return 0; else return lineindex[i-1].line;
+	}
+#endif
+
 	here2=here;
 	here=0;
 	gettoken();
@@ -3086,6 +4101,112 @@ address_t myline(address_t h) {
 		return l;
 }
 
+/*
+
+	The line index maps line numbers to addresses. It is sorted 
+	by line number, and as lines are stored in ascending order also 
+	by address. findline() and myline() search it binary. 
+
+	storeline() keeps it up to date. Every other change of the 
+	program invalidates it and the next findline() rebuilds it by 
+	one scan through the program. If the table overflows the 
+	interpreter falls back to scanning.
+
+*/
+
+#ifdef HASLINEINDEX
+void lineindexinit() {
+	lineindexsize=(memsize+1)/(addrsize+2);
+	lineindex=malloc(lineindexsize*sizeof(*lineindex));
+	if (lineindex == NULL) lineindexsize=0;
+	lineindexclear();
+}
+
+// an empty program has an empty and valid index
+void lineindexclear() {
+	nlines=0;
+	lineindexvalid=(lineindexsize > 0);
+}
+
+void lineindexbuild() {
+	address_t here2=here;
+
+	lineindexmisses++;
+	nlines=0;
+	lineindexvalid=FALSE;
+	if (lineindexsize == 0) return;
+
+	here=0;
+	while (here < top) {
+		gettoken();
+		if (token == LINENUMBER) {
+			if (nlines == lineindexsize) { here=here2; return; }
+			lineindex[nlines].line=x;
+			lineindex[nlines].addr=here-addrsize-1;
+			nlines++;
+		}
+	}
+	here=here2;
+	lineindexvalid=TRUE;
+}
+
+// the position of the first line with a number >= l 
+address_t lineindexfind(address_t l) {
+	address_t i=0;
+	address_t j=nlines;
+	address_t m;
+
+	while (i < j) {
+		m=(i+j)/2;
+		if (lineindex[m].line < l) i=m+1; else j=m;
+	}
+	return i;
+}
+
+// called after storeline() has stored or deleted line l, 
+// t is the top before, all following lines have moved 
+void lineindexupdate(address_t l, address_t t) {
+	address_t i, j, a;
+	char stored;
+
+	// a failed edit leaves the program alone unless top has moved
+	if (!lineindexvalid) return;
+	if (er != 0) { if (top != t) lineindexvalid=FALSE; return; }
+
+	// the old place of line l or of the line following it
+	i=lineindexfind(l);
+	if (i < nlines) a=lineindex[i].addr; else a=t;
+
+	// is there now a line l at the old place
+	stored=FALSE;
+	if (a < top && mem[a] == LINENUMBER) {
+		getnumber(a+1, addrsize);
+		stored=(z.a == l);
+	}
+
+	if (i < nlines && lineindex[i].line == l) {
+		if (!stored) { 
+			for (j=i; j+1<nlines; j++) lineindex[j]=lineindex[j+1];
+			nlines--;
+		} else 
+			i++;
+	} else if (stored) {
+		if (nlines == lineindexsize) { lineindexvalid=FALSE; return; }
+		for (j=nlines; j>i; j--) lineindex[j]=lineindex[j-1];
+		lineindex[i].line=l;
+		lineindex[i].addr=a;
+		nlines++;
+		i++;
+	} else {
+		lineindexvalid=FALSE; 
+		return;
+	}
+
+	// all lines after l move with top
+	for (j=i; j<nlines; j++) lineindex[j].addr=lineindex[j].addr+top-t;
+}
+#endif
+
 /*
 
    	Move a block of storage beginng at b ending at e
@@ -3140,7 +4261,14 @@ void zeroblock(address_t b, address_t l){
 
 	Very fragile code. 
 
+	In appendmode a line with a number larger than lastline 
+	stays at the top after stage 1, LOAD uses this for 
+	programs in ascending order.
+
 	zeroblock statements commented out after EOL code was fixed
+
+	storeline() wraps the editor, updates the line index and 
+	invalidates the compiled code.
 	
 */
 
@@ -3156,6 +4284,35 @@ void diag(){
 #endif
 
 void storeline() {
+#ifdef HASLINEINDEX
+	address_t l=x;
+	address_t t=top;
+#endif
+	editline();
+#ifdef HASLINEINDEX
+	lineindexupdate(l, t);
+#endif
+#ifdef HASCOMPILER
+	cvalid=FALSE;
+#endif
+#ifdef HASFORINDEX
+	forindexvalid=FALSE;
+#endif
+#ifdef HASVARINDEX
+	varindexvalid=FALSE;
+#endif
+#ifdef HASFUSE
+	fuseindexvalid=FALSE;
+#endif
+#ifdef HASFOLD
+	foldindexvalid=FALSE;
+#endif
+#ifdef HASSHORTCIRCUIT
+	skipindexvalid=FALSE;
+#endif
+}
+
+void editline() {
 
 	const short lnlength=addrsize+1;
 	short linelength;
@@ -3197,6 +4354,7 @@ void storeline() {
 */
 
 	if (linelength == (lnlength)) {  		
+		if (appendmode && x >= lastline) appendmode=FALSE;
 		top-=(lnlength);
 		y=x;					
 		findline(y);
@@ -3218,6 +4376,10 @@ void storeline() {
 	try to find it first by walking through all lines 
 */
 	else {	
+		if (appendmode && x > lastline) { 
+			lastline=x;
+			return;
+		}
 		y=x;
 		here2=here;
 		here=lnlength;
@@ -3331,7 +4493,7 @@ void parsenarguments(char n) {
 
 // parse a function argument ae is the number of 
 // expected expressions in the argument list
-void parsefunction(void (*f)(), short ae){
+LIBLOCAL void parsefunction(void (*f)(), short ae){
 	char args;
 
 	nexttoken();
@@ -3347,7 +4509,7 @@ void parsefunction(void (*f)(), short ae){
 }
 
 // helper function in the recursive decent parser
-void parseoperator(void (*f)()) {
+LIBLOCAL void parseoperator(void (*f)()) {
 	nexttoken();
 	f();
 	if (er !=0 ) return;
@@ -3367,6 +4529,37 @@ short parsesubscripts() {
 	return args;
 }
 
+// the element of array c d the subscripts on the stack select, 
+// one subscript counts the elements in the order of the payload
+void popsubscripts(short args, char c, char d, address_t* i) {
+#ifdef HASMULTIDIM
+	address_t a, m=1;
+	number_t s;
+#endif
+
+	*i=0;
+	if (args == 1) { *i=pop(); return; }
+#ifdef HASMULTIDIM
+	// the last subscript runs fastest, its extent is right below the payload
+	if (args > 1 && c != '@') {
+		a=bfind(ARRAYVAR, c, d);
+		if (a == 0) { error(EVARIABLE); return; }
+		if (mem[a+z.a] != args) { error(EARGS); return; }
+		*i=1;
+		while (args-- > 0) {
+			a-=addrsize;
+			getnumber(a, addrsize);
+			s=pop();
+			if (s < 1 || s > z.a) { error(ERANGE); return; }
+			*i+=(s-1)*m;
+			m*=z.a;
+		}
+		return;
+	}
+#endif
+	error(EARGS);
+}
+
 // substring evaluation, mind the rewinding here - a bit of a hack
 #ifdef HASAPPLE1
 void parsesubstring() {
@@ -3447,7 +4640,7 @@ void peek(){
 }
 
 // the fre function 
-void xfre() {
+LIBLOCAL void xfre() {
 	if (pop() >=0 )
 		push(himem-top);
 	else 
@@ -3583,25 +4776,29 @@ neq:
 // in factors calling function
 void factor(){
 	short args;
+	address_t i;
+	char xcl, ycl;
 	if (DEBUG) debug("factor\n");
 	switch (token) {
 		case NUMBER: 
 			push(x);
 			break;
 		case VARIABLE: 
+#ifdef HASVARINDEX
+			push(getvarat(here-3, xc, yc));
+#else
 			push(getvar(xc, yc));	
+#endif
 			break;
 		case ARRAYVAR:
-			push(yc);
-			push(xc);
+			xcl=xc;
+			ycl=yc;
 			nexttoken();
 			args=parsesubscripts();
 			if (er != 0 ) return;
-			if (args != 1) { error(EARGS); return; }	
-			x=pop();
-			xc=pop();
-			yc=pop();
-			array('g', xc, yc, x, &y);
+			popsubscripts(args, xcl, ycl, &i);
+			if (er != 0 ) return;
+			array('g', xcl, ycl, i, &y);
 			push(y); 
 			break;
 		case '(':
@@ -3621,6 +4818,14 @@ void factor(){
 		case TSIZE:
 			push(himem-top);
 			break;
+#ifdef HASARRAYOPS
+		case TSUM:
+		case TMIN:
+		case TMAX:
+		case TDOT:
+			arrayfunction(token);
+			break;
+#endif
 // Apple 1 BASIC functions
 #ifdef HASAPPLE1
 		case TSGN: 
@@ -3705,13 +4910,27 @@ void factor(){
 
 void term(){
 	if (DEBUG) debug("term\n"); 
+#ifdef HASFOLD
+	if (st == SRUN && folding && foldtoken(FOLDTERM)) goto termoperator;
+#endif
 	factor();
 	if (er != 0) return;
 
 nextfactor:
 	nexttoken();
+#ifdef HASFOLD
+termoperator:
+#endif
 	if (DEBUG) debug("in term\n");
 	if (token == '*'){
+#if defined(HASFOLD) && !defined(HASFLOAT)
+		if (st == SRUN && folding && foldnext(FOLDPRODUCT)) {
+			y=pop();
+			x=pop();
+			push(x*y);
+			goto termoperator;
+		}
+#endif
 		parseoperator(factor);
 		if (er != 0) return;
 		push(x*y);
@@ -3745,6 +4964,9 @@ nextfactor:
 
 void addexpression(){
 	if (DEBUG) debug("addexp\n");
+#ifdef HASFOLD
+	if (st == SRUN && folding && foldtoken(FOLDSUM)) goto nextterm;
+#endif
 	if (token != '+' && token != '-') {
 		term();
 		if (er != 0) return;
@@ -3754,6 +4976,14 @@ void addexpression(){
 
 nextterm:
 	if (token == '+' ) { 
+#if defined(HASFOLD) && !defined(HASFLOAT)
+		if (st == SRUN && folding && foldnext(FOLDSUM)) {
+			y=pop();
+			x=pop();
+			push(x+y);
+			goto nextterm;
+		}
+#endif
 		parseoperator(term);
 		if (er != 0) return;
 		push(x+y);
@@ -3821,6 +5051,9 @@ void andexpression() {
 	notexpression();
 	if (er != 0) return;
 	if (token == TAND) {
+#ifdef HASSHORTCIRCUIT
+		if (shortcircuit && stack[sp-1] == 0 && skipoperand()) return;
+#endif
 		parseoperator(expression);
 		if (er != 0) return;
 		push(x && y);
@@ -3829,15 +5062,564 @@ void andexpression() {
 
 void expression(){
 	if (DEBUG) debug("exp\n"); 
+#ifdef HASFOLD
+	if (st == SRUN && folding && foldtoken(FOLDEXPRESSION)) return;
+#endif
+#ifdef HASPRATT
+	if (prattmode) { prattexpression(); return; }
+#endif
 	andexpression();
 	if (er != 0) return;
 	if (token == TOR) {
+#ifdef HASSHORTCIRCUIT
+		if (shortcircuit && stack[sp-1] != 0 && skipoperand()) { stack[sp-1]=1; return; }
+#endif
 		parseoperator(expression);
 		if (er != 0) return;
 		push(x || y);
 	}  
 }
 
+/*
+	Short circuit AND and OR. With shortcircuit set a false left 
+	side of AND and a true left side of OR decide the result and 
+	the right side, which is everything up to the end of the 
+	expression, is skipped without evaluating it. skipend() finds 
+	the end from the tokens in memory, it gives up on strings and 
+	functions without arguments, then the right side is evaluated 
+	as before. Programs in memory keep the ends in skipindex, the 
+	table is emptied after a change of the program. Interactive 
+	expressions are always evaluated completely.
+*/
+
+#ifdef HASSHORTCIRCUIT
+void skipindexinit() {
+	address_t n=(memsize+1)/16;
+
+	if (n > 512) n=512;
+
+	skipindexsize=1;
+	while (skipindexsize/2 < n) skipindexsize*=2;
+	skipindex=malloc(skipindexsize*sizeof(*skipindex));
+	if (skipindex == NULL) { skipindexsize=0; return; }
+	skipindexclear();
+}
+
+void skipindexclear() {
+	address_t i;
+
+	for (i=0; i<skipindexsize; i++) skipindex[i].p=0;
+	skipindexused=0;
+	skipindexvalid=TRUE;
+}
+
+// the slot of position p or the free slot where it belongs
+address_t skipindexfind(address_t p) {
+	address_t i=(p*31) & (skipindexsize-1);
+
+	while (skipindex[i].p != 0 && skipindex[i].p != p) i=(i+1) & (skipindexsize-1);
+	return i;
+}
+
+// the end of the expression starting at p, p if it is not clear
+address_t skipend(address_t p) {
+	address_t p0=p;
+	short depth=0;
+	char operand=TRUE;
+
+	while (p < top) {
+		if (operand) {
+			switch (mem[p]) {
+				case TNOT: 
+				case '+': 
+				case '-':
+					p++;
+					break;
+				case '(':
+					depth++;
+					p++;
+					break;
+				case NUMBER: 
+				case VARIABLE:
+					p+=tokenlength(p);
+					operand=FALSE;
+					break;
+				case ARRAYVAR:
+					p+=3;
+					if (p >= top || mem[p] != '(') return p0;
+					break;
+				case STRING:
+				case STRINGVAR:
+				case LINENUMBER:
+					return p0;
+				default: // a function and its arguments
+					if (p+1 >= top || mem[p+1] != '(') return p0;
+					p++;
+			}
+		} else {
+			switch (mem[p]) {
+				case '*': case '/': case '%': case '+': case '-': 
+				case '=': case NOTEQUAL: case '<': case '>': case LESSEREQUAL: case GREATEREQUAL:
+				case TAND: case TOR:
+					operand=TRUE;
+					p++;
+					break;
+				case ')':
+					if (depth == 0) return p;
+					depth--;
+					p++;
+					break;
+				case ',':
+					if (depth == 0) return p;
+					operand=TRUE;
+					p++;
+					break;
+				default:
+					if (depth == 0) return p;
+					return p0;
+			}
+		}
+	}
+	if (!operand && depth == 0) return p;
+	return p0;
+}
+
+// skip the right side of the AND or OR token, FALSE if it has to be evaluated
+char skipoperand() {
+	address_t i, e;
+
+	if (st != SRUN || skipindexsize == 0) return FALSE;
+	if (!skipindexvalid) skipindexclear();
+
+	i=skipindexfind(here);
+	if (skipindex[i].p == here) {
+		e=skipindex[i].e;
+	} else {
+		e=skipend(here);
+		if (2*(skipindexused+1) <= skipindexsize) {
+			skipindex[i].p=here;
+			skipindex[i].e=e;
+			skipindexused++;
+		}
+	}
+	if (e == here) return FALSE;
+
+	skipcount++;
+	here=e;
+	nexttoken();
+	return TRUE;
+}
+#endif
+
+/*
+	The Pratt evaluator does the work of expression() down to 
+	factor() in one loop. The numbers are on stack[], the operators 
+	waiting for their right operand and the open brackets in ops[]. 
+	The binding powers are the levels of the recursive descent: 
+	AND and OR bind weakest and from the right, NOT applies to a 
+	whole comparison, the comparisons group from the right, + - and 
+	* / % from the left. A sign is read as 0+ or 0-, NOT can only 
+	start an expression or follow AND, OR and a bracket. Brackets 
+	have power 0 and stop the reduction. Other operands are left 
+	to factor() which also reports their errors.
+*/
+
+#ifdef HASPRATT
+#define PRATTDEPTH 32
+
+// the binding power of an operator, 0 ends the expression
+char prattpower(signed char t) {
+	switch (t) {
+		case TOR: 
+		case TAND: 
+			return 1;
+		case TNOT: 
+			return 2;
+		case '=': 
+		case NOTEQUAL: 
+		case '<': 
+		case '>': 
+		case LESSEREQUAL: 
+		case GREATEREQUAL: 
+			return 3;
+		case '+': 
+		case '-': 
+			return 4;
+		case '*': 
+		case '/': 
+		case '%': 
+			return 5;
+	}
+	return 0;
+}
+
+// apply the operator t to the numbers on top of the stack in place, 
+// the loop has put them there so there is no need to check sp, 
+// x and y are left alone as they belong to the token read ahead 
+void prattreduce(signed char t) {
+	number_t* r;
+	number_t u, v;
+
+	if (t == TNOT) {
+		stack[sp-1]=!stack[sp-1];
+		return;
+	}
+	r=&stack[sp-2];
+	u=r[0];
+	v=r[1];
+	sp--;
+	switch (t) {
+		case TOR: *r=(u || v); break;
+		case TAND: *r=(u && v); break;
+		case '=': *r=(u == v); break;
+		case NOTEQUAL: *r=(u != v); break;
+		case '<': *r=(u < v); break;
+		case '>': *r=(u > v); break;
+		case LESSEREQUAL: *r=(u <= v); break;
+		case GREATEREQUAL: *r=(u >= v); break;
+		case '+': *r=u+v; break;
+		case '-': *r=u-v; break;
+		case '*': *r=u*v; break;
+		case '/':
+		case '%':
+			if (v == 0) { error(EDIVIDE); return; }
+#ifndef HASFLOAT
+			if (t == '/') *r=u/v; else *r=u%v;
+#else 
+			if (t == '/') *r=u/v; else *r=(int)u%(int)v;
+#endif
+			break;
+	}
+}
+
+void prattexpression() {
+	signed char ops[PRATTDEPTH];
+	char powers[PRATTDEPTH];
+	short n=0;
+	char p;
+
+	if (DEBUG) debug("prattexp\n"); 
+
+operand:
+	// NOT, a sign or a bracket in front of an operand
+	if (token == TNOT && (n == 0 || powers[n-1] <= 1)) {
+		if (n == PRATTDEPTH) { error(ESTACK); return; }
+		powers[n]=2;
+		ops[n++]=TNOT;
+		nexttoken();
+		goto operand;
+	}
+	if (token == '(') {
+		if (n == PRATTDEPTH) { error(ESTACK); return; }
+		powers[n]=0;
+		ops[n++]='(';
+		nexttoken();
+#ifdef HASFOLD
+		if (st == SRUN && folding && foldtoken(FOLDEXPRESSION)) goto operator;
+#endif
+		goto operand;
+	}
+	if (token == NUMBER) {
+		push(x);
+		nexttoken();
+	} else if ((token == '+' || token == '-') && (n == 0 || powers[n-1] <= 3)) {
+		push(0);
+	} else {
+		factor();
+		if (er != 0) return;
+		nexttoken();
+	}
+
+operator:
+	// apply the operators binding stronger than the next one
+	if (token == TNOT) p=0; else p=prattpower(token);
+	while (n > 0 && (powers[n-1] > p || (p > 3 && powers[n-1] == p))) {
+		prattreduce(ops[--n]);
+		if (er != 0) return;
+	}
+
+#ifdef HASSHORTCIRCUIT
+	// the left side of AND or OR can decide, the right side is all up to the end
+	if (p == 1 && shortcircuit && (token == TAND ? stack[sp-1] == 0 : stack[sp-1] != 0) && skipoperand()) {
+		if (stack[sp-1] != 0) stack[sp-1]=1;
+		goto operator;
+	}
+#endif
+
+	// the end of a bracket or of the expression
+	if (p == 0) {
+		if (n == 0) return;
+		if (token != ')') { error(EARGS); return; }
+		n--;
+		nexttoken();
+		goto operator;
+	}
+
+	if (n == PRATTDEPTH) { error(ESTACK); return; }
+	powers[n]=p;
+	ops[n++]=token;
+	nexttoken();
+	goto operand;
+}
+#endif
+
+/*
+	Constant folding. Runs of numbers, brackets and the operators 
+	+ - * / % are evaluated once for the whole program. foldindex 
+	stores for each position where such a run starts the longest 
+	sum of complete terms, the longest product of factors and the 
+	longest run of * only, with their values and ends. 
+	
+	expression() takes a sum that is the entire expression, 
+	addexpression() takes the sum at its start and term() the product 
+	at its start. These are the first operations the interpreter 
+	would do anyway and folding them gives the same result. Right 
+	of a + the rest of a sum and right of a * the rest of a run of * 
+	are folded as well, in integer arithmetic this is the same number.
+	Right of - and / nothing more than the next term or factor can 
+	be folded. 
+
+	The program in memory is not changed and LIST shows it as 
+	entered. The arithmetic is the one of term() and addexpression(), 
+	a division by zero is not folded and raises its error at runtime. 
+	Every change of the program invalidates the table and the next 
+	expression rebuilds it.
+*/
+
+#ifdef HASFOLD
+// a number or a bracket of numbers at *p, its value in *v
+char foldfactor(address_t* p, number_t* v) {
+	address_t q;
+
+	if (*p >= top) return FALSE;
+	if (mem[*p] == NUMBER) {
+		getnumber(*p+1, numsize);
+		*v=z.i;
+		*p+=numsize+1;
+		return TRUE;
+	}
+	if (mem[*p] == '(') {
+		q=*p+1;
+		if (!foldsum(&q, v)) return FALSE;
+		if (q >= top || mem[q] != ')') return FALSE;
+		*p=q+1;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+// the longest product of factors at *p
+char foldterm(address_t* p, number_t* v) {
+	address_t q;
+	number_t w;
+	char c;
+
+	if (!foldfactor(p, v)) return FALSE;
+	while (*p < top && (mem[*p] == '*' || mem[*p] == '/' || mem[*p] == '%')) {
+		c=mem[*p];
+		q=*p+1;
+		if (!foldfactor(&q, &w)) break;
+		if (c != '*' && w == 0) break;
+		switch (c) {
+			case '*': 
+				*v=*v*w; 
+				break;
+			case '/': 
+				*v=*v/w; 
+				break;
+			case '%':
+#ifndef HASFLOAT
+				*v=*v%w;
+#else 
+				*v=(int)*v%(int)w;
+#endif
+				break;
+		}
+		*p=q;
+	}
+	return TRUE;
+}
+
+// the longest sum of complete terms at *p
+char foldsum(address_t* p, number_t* v) {
+	address_t q, s=*p;
+	number_t w;
+	char c;
+
+	if (*p < top && (mem[*p] == '+' || mem[*p] == '-')) 
+		*v=0;
+	else if (!foldterm(p, v) || !foldtermend(*p)) 
+		return FALSE;
+	while (*p < top && (mem[*p] == '+' || mem[*p] == '-')) {
+		c=mem[*p];
+		q=*p+1;
+		if (!foldterm(&q, &w) || !foldtermend(q)) break;
+		if (c == '+') *v=*v+w; else *v=*v-w;
+		*p=q;
+	}
+	return *p != s;
+}
+
+#ifndef HASFLOAT
+// the longest run of factors joined by * at *p
+char foldproduct(address_t* p, number_t* v) {
+	address_t q;
+	number_t w;
+
+	if (!foldfactor(p, v)) return FALSE;
+	while (*p < top && mem[*p] == '*') {
+		q=*p+1;
+		if (!foldfactor(&q, &w)) break;
+		*v=*v*w;
+		*p=q;
+	}
+	return TRUE;
+}
+#endif
+
+// can the token at p not continue a term
+char foldtermend(address_t p) {
+	return p >= top || (mem[p] != '*' && mem[p] != '/' && mem[p] != '%');
+}
+
+// can the token at p not continue an expression 
+char foldend(address_t p) {
+	if (p >= top) return TRUE;
+	switch (mem[p]) {
+		case '*': case '/': case '%': case '+': case '-': 
+		case '=': case NOTEQUAL: case '<': case '>': case LESSEREQUAL: case GREATEREQUAL:
+		case TAND: case TOR:
+			return FALSE;
+	}
+	return TRUE;
+}
+
+// is the token an arithmetic operator
+char foldoperator(char c) {
+	return c == '*' || c == '/' || c == '%' || c == '+' || c == '-';
+}
+
+// does a run from p to e contain an operator, a single number does not  
+char foldlonger(address_t p, address_t e) {
+	return e > p && !(mem[p] == NUMBER && e == p+numsize+1);
+}
+
+// two scans, one counting and one storing the runs
+void foldindexbuild() {
+	address_t p, s, t, m, i, n=0;
+	number_t vs, vt, vm;
+	char pass;
+
+	free(foldindex);
+	foldindex=NULL;
+	foldindexsize=0;
+	foldindexvalid=TRUE;
+
+	for (pass=0; pass<2; pass++) {
+		for (p=0; p<top; p+=tokenlength(p)) {
+			if (mem[p] != NUMBER && mem[p] != '(' && mem[p] != '+' && mem[p] != '-') continue;
+			s=t=m=p;
+			if (!foldsum(&s, &vs) || !foldlonger(p, s)) s=0;
+			if (mem[p] == '+' || mem[p] == '-' || !foldterm(&t, &vt) || !foldlonger(p, t)) t=0;
+#ifndef HASFLOAT
+			if (mem[p] == '+' || mem[p] == '-' || !foldproduct(&m, &vm) || !foldlonger(p, m)) m=0;
+#else
+			m=0;
+			vm=0;
+#endif
+			if (s == 0 && t == 0 && m == 0) continue;
+			if (pass == 0) { 
+				n++; 
+				continue; 
+			}
+			i=foldindexfind(p);
+			foldindex[i].p=p;
+			foldindex[i].s=s;
+			foldindex[i].t=t;
+			foldindex[i].m=m;
+			foldindex[i].vs=vs;
+			foldindex[i].vt=vt;
+			foldindex[i].vm=vm;
+			foldindex[i].e=(s != 0 && foldend(s));
+		}
+		if (pass == 0) {
+			if (n == 0) return;
+			foldindexsize=1;
+			while (foldindexsize/2 < n) foldindexsize*=2;
+			foldindex=malloc(foldindexsize*sizeof(*foldindex));
+			if (foldindex == NULL) { foldindexsize=0; return; }
+			for (i=0; i<foldindexsize; i++) foldindex[i].p=0;
+		}
+	}
+}
+
+// the slot of position p or the free slot where it belongs, p=0 is a line number and marks free slots
+address_t foldindexfind(address_t p) {
+	address_t i=(p*31) & (foldindexsize-1);
+
+	while (foldindex[i].p != 0 && foldindex[i].p != p) i=(i+1) & (foldindexsize-1);
+	return i;
+}
+
+// push the folded run of kind k starting at p and continue after it 
+char foldat(address_t p, char k) {
+	address_t i, e;
+	number_t v;
+
+	if (!foldindexvalid) foldindexbuild();
+	if (foldindexsize == 0) return FALSE;
+	i=foldindexfind(p);
+	if (foldindex[i].p == 0) return FALSE;
+
+	switch (k) {
+		case FOLDEXPRESSION:
+			if (!foldindex[i].e) return FALSE;
+			e=foldindex[i].s;
+			v=foldindex[i].vs;
+			break;
+		case FOLDSUM:
+			e=foldindex[i].s;
+			v=foldindex[i].vs;
+			break;
+		case FOLDTERM:
+			e=foldindex[i].t;
+			v=foldindex[i].vt;
+			break;
+		default:
+			e=foldindex[i].m;
+			v=foldindex[i].vm;
+	}
+	if (e == 0) return FALSE;
+
+	foldhits++;
+	push(v);
+	here=e;
+	nexttoken();
+	return TRUE;
+}
+
+// a run starting at the token, a number followed by no operator is none 
+char foldtoken(char k) {
+	if (token == NUMBER) {
+		if (here >= top || !foldoperator(mem[here])) return FALSE;
+		return foldat(here-numsize-1, k);
+	}
+	if (token == '(' || token == '+' || token == '-') return foldat(here-1, k);
+	return FALSE;
+}
+
+// a run starting after the operator token, only numbers and brackets start it
+char foldnext(char k) {
+	if (here >= top) return FALSE;
+	if (mem[here] == NUMBER) {
+		if (here+numsize+1 >= top || !foldoperator(mem[here+numsize+1])) return FALSE;
+		return foldat(here, k);
+	}
+	if (mem[here] == '(') return foldat(here, k);
+	return FALSE;
+}
+#endif
+
 /* 
 	The commands and their helpers
     
@@ -3930,6 +5712,7 @@ separators:
 
 void lefthandside(address_t* i, char* ps) {
 	short args;
+	char xcl=xc, ycl=yc;
 
 	switch (token) {
 		case VARIABLE:
@@ -3940,11 +5723,7 @@ void lefthandside(address_t* i, char* ps) {
 			args=parsesubscripts();
 			nexttoken();
 			if (er != 0) return;
-			if (args != 1) {
-				error(EARGS);
-				return;
-			}
-			*i=pop();
+			popsubscripts(args, xcl, ycl, i);
 			break;
 #ifdef HASAPPLE1
 		case STRINGVAR:
@@ -4008,6 +5787,9 @@ void assignment() {
 	address_t lensource, lendest, newlength;
 	short args;
 	char s;
+#ifdef HASVARINDEX
+	address_t p=here-3; // the position of the variable token
+#endif
 
 	// this code evaluates the left hand side
 	ycl=yc;
@@ -4033,6 +5815,13 @@ void assignment() {
 		case ARRAYVAR: // the lefthandside is a scalar, evaluate the righthandside as a number
 			expression();
 			if (er != 0 ) return;
+#ifdef HASVARINDEX
+			if (t == VARIABLE) {
+				x=pop();
+				setvarat(p, xcl, ycl, x);
+				break;
+			}
+#endif
 			assignnumber(t, xcl, ycl, i, ps);
 			break;
 #ifdef HASAPPLE1
@@ -4169,6 +5958,8 @@ void assignment() {
 
 void xinput(){
 	short args;
+	address_t i;
+	char xcl, ycl;
 	short oldid = -1;
 
 	nexttoken();
@@ -4215,24 +6006,24 @@ nextvariable:
 
 	if (token == ARRAYVAR) {
 
+		xcl=xc;
+		ycl=yc;
 		nexttoken();
 		args=parsesubscripts();
 		if (er != 0 ) return;
-		if (args != 1) {
-			error(EARGS);
-			return;
-		}
+		popsubscripts(args, xcl, ycl, &i);
+		if (er != 0 ) return;
 
 		if (id != IFILE) outsc("? ");
 		if (innumber(&x) == BREAKCHAR) {
 			x=0;
-			array('s', xc, yc, pop(), &x);
+			array('s', xcl, ycl, i, &x);
 			st=SINT;
 			nexttoken();
 			id=oldid;
 			return;
 		} else {
-			array('s', xc, yc, pop(), &x);
+			array('s', xcl, ycl, i, &x);
 		}
 	}
 
@@ -4266,7 +6057,7 @@ nextvariable:
 
 #ifdef HASGOSUB
 void pushgosubstack(){
-	if (gosubsp < GOSUBDEPTH) {
+	if (gosubsp < gosubdepth) {
 		gosubstack[gosubsp]=here;
 		gosubsp++;	
 	} else 
@@ -4303,12 +6094,18 @@ void xgoto() {
 	expression();
 	if (er != 0) return;
 
+	gotoline(t, pop());
+}
+
+// the jump of GOTO and GOSUB once the line number is known 
+void gotoline(signed char t, number_t l) {
+
 #ifdef HASGOSUB
 	if (t == TGOSUB) pushgosubstack();
 	if (er != 0) return;
 #endif
 
-	x=pop();
+	x=l;
 	findline(x);
 	if ( er != 0 ) return;
 	if (st == SINT) st=SRUN;
@@ -4338,9 +6135,14 @@ void xif() {
 	if (er != 0 ) return;
 
 	x=pop();
+	xthen();
+}
+
+// the condition is in x
+void xthen() {
 	if (DEBUG) { outnumber(x); outcr(); } 
 	if (! x) // on condition false skip the entire line
-		do nexttoken();	while (token != LINENUMBER && token !=EOL && here <= top);
+		skipline();
 		
 	if (token == TTHEN) {
 		nexttoken();
@@ -4351,6 +6153,184 @@ void xif() {
 	} 
 }
 
+/*
+	Superinstructions run the most common statement shapes 
+	without the expression parser
+		V=A, V=A+B, V=A-B, V=A*B
+		IF A op B THEN with op one of =, <>, <, >, <=, >=
+		GOTO n and GOSUB n
+	where A and B are numbers or variables other than the @ 
+	specials. The shape of a statement is found when it first 
+	runs and kept in fuseindex for its position, every other 
+	shape goes to the generic code. The table is as long as 
+	the program and emptied on the next use after a change.
+*/
+
+#ifdef HASFUSE
+#define FUSEUNKNOWN 0
+#define FUSENONE 	1
+#define FUSEASSIGN 	2
+#define FUSEIF 		3
+#define FUSEGOTO 	4
+
+void fuseindexclear() {
+	address_t i;
+
+	if (fuseindexsize < top) {
+		free(fuseindex);
+		fuseindexsize=top;
+		fuseindex=malloc(fuseindexsize);
+		if (fuseindex == NULL) fuseindexsize=0;
+	}
+	for (i=0; i<fuseindexsize; i++) fuseindex[i]=FUSEUNKNOWN;
+	fuseindexvalid=TRUE;
+}
+
+// the length of the number or variable at p, 0 for anything else
+address_t fuseoperand(address_t p) {
+	if (p >= top) return 0;
+	if (mem[p] == NUMBER) return numsize+1;
+	if (mem[p] == VARIABLE && mem[p+1] != '@') return 3;
+	return 0;
+}
+
+// does a statement end at p
+char fuseterm(address_t p) {
+	return (p >= top || mem[p] == ':' || mem[p] == LINENUMBER || mem[p] == EOL);
+}
+
+// the value of the number or variable at p
+number_t fusevalue(address_t p) {
+	if (mem[p] == NUMBER) {
+		getnumber(p+1, numsize);
+		return z.i;
+	}
+#ifdef HASVARINDEX
+	return getvarat(p, mem[p+1], mem[p+2]);
+#else
+	return getvar(mem[p+1], mem[p+2]);
+#endif
+}
+
+// the shape of the statement at p
+signed char fusematch(address_t p) {
+	address_t l;
+
+	switch (mem[p]) {
+		case VARIABLE:
+			if (mem[p+1] == '@') return FUSENONE;
+			p+=3;
+			if (p >= top || mem[p] != '=') return FUSENONE;
+			p++;
+			if (!(l=fuseoperand(p))) return FUSENONE;
+			p+=l;
+			if (fuseterm(p)) return FUSEASSIGN;
+			if (mem[p] != '+' && mem[p] != '-' && mem[p] != '*') return FUSENONE;
+			p++;
+			if (!(l=fuseoperand(p))) return FUSENONE;
+			if (fuseterm(p+l)) return FUSEASSIGN;
+			return FUSENONE;
+		case TIF:
+			p++;
+			if (!(l=fuseoperand(p))) return FUSENONE;
+			p+=l;
+			switch (mem[p]) {
+				case '=': case NOTEQUAL: case '<': case '>': case LESSEREQUAL: case GREATEREQUAL:
+					break;
+				default:
+					return FUSENONE;
+			}
+			p++;
+			if (!(l=fuseoperand(p))) return FUSENONE;
+			p+=l;
+			if (p < top && mem[p] == TTHEN) return FUSEIF;
+			return FUSENONE;
+		case TGOTO:
+#ifdef HASGOSUB
+		case TGOSUB:
+#endif
+			p++;
+			if (p < top && mem[p] == NUMBER && fuseterm(p+numsize+1)) return FUSEGOTO;
+			return FUSENONE;
+	}
+	return FUSENONE;
+}
+
+// run the statement at the token as superinstruction, FALSE if it has another shape
+char fusestatement() {
+	address_t p, a;
+	signed char k;
+	number_t v, w;
+	char c;
+
+	if (token == VARIABLE) p=here-3; else p=here-1;
+	if (!fuseindexvalid) fuseindexclear();
+	if (p >= fuseindexsize) return FALSE;
+	k=fuseindex[p];
+	if (k == FUSEUNKNOWN) k=fuseindex[p]=fusematch(p);
+	if (k == FUSENONE) return FALSE;
+	fusecount++;
+
+	switch (k) {
+		case FUSEASSIGN:
+			a=p+4;
+			v=fusevalue(a);
+			if (er != 0) return TRUE;
+			a+=fuseoperand(a);
+			if (!fuseterm(a)) {
+				c=mem[a++];
+				w=fusevalue(a);
+				if (er != 0) return TRUE;
+				a+=fuseoperand(a);
+				switch (c) {
+					case '+': v=v+w; break;
+					case '-': v=v-w; break;
+					case '*': v=v*w; break;
+				}
+			}
+			x=v;
+#ifdef HASVARINDEX
+			setvarat(p, mem[p+1], mem[p+2], x);
+#else
+			setvar(mem[p+1], mem[p+2], x);
+#endif
+			if (er != 0) return TRUE;
+			here=a;
+			nexttoken();
+			return TRUE;
+		case FUSEIF:
+			a=p+1;
+			v=fusevalue(a);
+			if (er != 0) return TRUE;
+			a+=fuseoperand(a);
+			c=mem[a++];
+			w=fusevalue(a);
+			if (er != 0) return TRUE;
+			a+=fuseoperand(a);
+			switch (c) {
+				case '=': x=(v == w); break;
+				case NOTEQUAL: x=(v != w); break;
+				case '<': x=(v < w); break;
+				case '>': x=(v > w); break;
+				case LESSEREQUAL: x=(v <= w); break;
+				case GREATEREQUAL: x=(v >= w); break;
+			}
+			here=a;
+			nexttoken();
+			xthen();
+			return TRUE;
+		case FUSEGOTO:
+			getnumber(p+2, numsize);
+			v=z.i;
+			here=p+2+numsize;
+			nexttoken();
+			gotoline(mem[p], v);
+			return TRUE;
+	}
+	return FALSE;
+}
+#endif
+
 /* 
 
 	for, next and the apocryphal break
@@ -4359,21 +6339,85 @@ void xif() {
 
 #ifdef HASFORNEXT
 
-// find the NEXT token or the end of the program
+// find the NEXT token or the end of the program, without 
+// a NEXT the error is reported in the line the search started
 void findnext(){
+	address_t h=here;
+#ifdef HASFORINDEX
+	address_t i=0;
+
+	if (st == SRUN && forindexsize) {
+		if (!forindexvalid) forindexclear();
+		i=forindexfind(h);
+		if (forindex[i].f == h) {
+			here=forindex[i].n;
+			token=TNEXT;
+			forindexhits++;
+			return;
+		}
+		forindexmisses++;
+	}
+#endif
 	while (TRUE) {
 	    if (token == TNEXT) {
-	    	if (fnc == 0) return;
+	    	if (fnc == 0) break;
 	    	else fnc--;
 	    }
 	    if (token == TFOR) fnc++;
 	    if (here >= top) {
-	    	error(TFOR);
+	    	here=h;
+	    	error(ENEXT);
 	    	return;
 	    }
 		nexttoken(); 
 	}
+#ifdef HASFORINDEX
+	// remember the NEXT while the table is half empty
+	if (st == SRUN && forindexsize && 2*(forindexused+1) <= forindexsize) {
+		forindex[i].f=h;
+		forindex[i].n=here;
+		forindexused++;
+	}
+#endif
+}
+
+/*
+	The for index is an open addressed hash table keyed by the 
+	position findnext() starts from, FOR statements whose loop is 
+	not run and BREAK. It stores the position after the matching 
+	NEXT. Entries are added on the first search, every change of 
+	the program invalidates the table and the next search empties it.
+*/
+
+#ifdef HASFORINDEX
+void forindexinit() {
+	address_t n=(memsize+1)/16;
+
+	if (n > 512) n=512;
+
+	forindexsize=1;
+	while (forindexsize/2 < n) forindexsize*=2;
+	forindex=malloc(forindexsize*sizeof(*forindex));
+	if (forindex == NULL) { forindexsize=0; return; }
+	forindexclear();
+}
+
+void forindexclear() {
+	address_t i;
+
+	for (i=0; i<forindexsize; i++) forindex[i].f=0;
+	forindexused=0;
+	forindexvalid=TRUE;
+}
+
+// the slot of position f or the free slot where it belongs
+address_t forindexfind(address_t f) {
+	address_t i=(f*31) & (forindexsize-1);
+
+	while (forindex[i].f != 0 && forindex[i].f != f) i=(i+1) & (forindexsize-1);
+	return i;
 }
+#endif
 
 
 /*
@@ -4385,6 +6429,9 @@ void findnext(){
 
 void xfor(){
 	char xcl, ycl;
+#ifdef HASVARINDEX
+	address_t p;
+#endif
 	
 	nexttoken();
 	if (token != VARIABLE) {
@@ -4393,6 +6440,9 @@ void xfor(){
 	}
 	xcl=xc;
 	ycl=yc;
+#ifdef HASVARINDEX
+	p=here-3;
+#endif
 
 	nexttoken();
 	if (token != '=') { 
@@ -4405,7 +6455,11 @@ void xfor(){
 	if (er != 0) return;
 
 	x=pop();	
+#ifdef HASVARINDEX
+	setvarat(p, xcl, ycl, x);
+#else
 	setvar(xcl, ycl, x);
+#endif
 	if (DEBUG) { outch(xcl); outch(ycl); outspc(); outnumber(x); outcr(); }
 
 	if (token != TTO){
@@ -4576,7 +6630,7 @@ void xlist(){
 	switch (arg) {
 		case 0: 
 			b=0;
-			e=32767;
+			e=maxnum;
 			break;
 		case 1: 
 			b=pop();
@@ -4609,16 +6663,26 @@ void xlist(){
 		}
 	}
 	if (here == top && oflag) outputtoken();
-    if (e == 32767 || b != e) outcr(); // supress newlines in "list 50" - a little hack
+    if (e == maxnum || b != e) outcr(); // supress newlines in "list 50" - a little hack
 
 	nexttoken();
  }
 
 
 void xrun(){
+#ifdef HASCOMPILER
+	address_t h;
+#endif
+
+#ifdef HASBUDGET
+	budgetstart();
+#endif
 	if (token == TCONT) {
 		st=SRUN;
 		nexttoken();
+#ifdef HASCOMPILER
+		if (cmode && cvalid && (token == ':' || token == LINENUMBER)) crun(here);
+#endif
 		goto statementloop;
 	} 
 
@@ -4633,13 +6697,36 @@ void xrun(){
 	if ( er != 0 ) return;
 	if (st == SINT) st=SRUN;
 
+#ifdef HASPROFILER
+	if (profiling) profileclear();
+	if (er != 0) return;
+#endif
+
+#ifdef HASCOMPILER
+	h=here;
+	if (cmode && ! cvalid && st == SRUN) ccompile();
+	here=h;
+#endif
+
 	xclr();
 
+#ifdef HASCOMPILER
+#ifdef HASPROFILER
+	if (cmode && cvalid && st == SRUN && ! profiling) crun(h);
+#else
+	if (cmode && cvalid && st == SRUN) crun(h);
+#endif
+#endif
+
 statementloop:
-	while ( (here < top) && (st == SRUN || st == SERUN) && ! er) {	
+	while ( (here < top || token != EOL) && (st == SRUN || st == SERUN) && ! er) {	
 		statement();
 	}
 	st=SINT;
+#ifdef HASPROFILER
+	profilestop();
+#endif
+	outflush();
 }
 
 
@@ -4650,7 +6737,31 @@ void xnew(){ // the general cleanup function
 	zeroblock(top,himem);
 	reseterror();
 	st=SINT;
+#ifdef HASHEAPINDEX
+	heapindexclear();
+#endif
 	nvars=0;
+#ifdef HASLINEINDEX
+	lineindexclear();
+#endif
+#ifdef HASCOMPILER
+	cvalid=FALSE;
+#endif
+#ifdef HASFORINDEX
+	forindexvalid=FALSE;
+#endif
+#ifdef HASVARINDEX
+	varindexvalid=FALSE;
+#endif
+#ifdef HASFUSE
+	fuseindexvalid=FALSE;
+#endif
+#ifdef HASFOLD
+	foldindexvalid=FALSE;
+#endif
+#ifdef HASSHORTCIRCUIT
+	skipindexvalid=FALSE;
+#endif
 
 #ifdef HASGOSUB
 	clrgosubstack();
@@ -4662,7 +6773,7 @@ void xnew(){ // the general cleanup function
 
 
 void xrem() {
-	while (token != LINENUMBER && token != EOL && here <= top) nexttoken(); 
+	if (token != LINENUMBER && token != EOL) skipline();
 }
 
 /* 
@@ -4713,14 +6824,20 @@ nextvariable:
 
 		args=parsesubscripts();
 		if (er != 0) return;
-		if (args != 1) {error(EARGS); return; }
-		x=pop();
-		if (x<=0) {error(ERANGE); return; }
 		if (t == STRINGVAR) {
+			if (args != 1) {error(EARGS); return; }
+			x=pop();
+			if (x<=0) {error(ERANGE); return; }
 			if ( (x>255) && (strindexsize==1) ) {error(ERANGE); return; }
 			createstring(xcl, ycl, x);
 		} else {
-			createarray(xcl, ycl, x);
+#ifdef HASMULTIDIM
+			// DIM A(I, J, K) has I*J*K elements, the last subscript runs fastest
+			if (args < 1) {error(EARGS); return; }
+#else
+			if (args != 1) {error(EARGS); return; }
+#endif
+			createarray(xcl, ycl, args);
 		}	
 	} else {
 		error(EUNKNOWN);
@@ -4735,6 +6852,117 @@ nextvariable:
 	nexttoken();
 }
 
+/*
+	FILL, COPY, SUM, MIN, MAX and DOT work on whole DIMed arrays.
+	The elements are numsize bytes each and contiguous in the payload 
+	of bmalloc(), element 1 at the lowest address. Every operation 
+	is one simple loop over the payload. The memcpy() of a number is 
+	one unaligned load or store and the compiler can unroll and 
+	vectorize the loops.
+
+		FILL A, v	sets all elements of A to v
+		COPY A TO B	copies A into the first elements of B
+		SUM(A), MIN(A), MAX(A), DOT(A, B) 
+*/
+#ifdef HASARRAYOPS
+// the payload address and the number of elements of a DIMed array
+address_t arraypayload(char c, char d, address_t* n) {
+	address_t a;
+
+	*n=0;
+	if (c == '@') { error(EVARIABLE); return 0; }
+	a=bfind(ARRAYVAR, c, d);
+	if (a == 0) { error(EVARIABLE); return 0; }
+	*n=z.a/numsize;
+	return a;
+}
+
+void xfill() {
+	address_t a, n, i;
+	number_t v;
+	char xcl, ycl;
+
+	nexttoken();
+	if (token != VARIABLE) { error(EUNKNOWN); return; }
+	xcl=xc;
+	ycl=yc;
+	nexttoken();
+	if (token != ',') { error(EUNKNOWN); return; }
+	nexttoken();
+	expression();
+	if (er != 0) return;
+	v=pop();
+
+	a=arraypayload(xcl, ycl, &n);
+	if (er != 0) return;
+	for (i=0; i<n; i++) memcpy(&mem[a+i*numsize], &v, numsize);
+}
+
+void xcopy() {
+	address_t a, b, n, m;
+
+	nexttoken();
+	if (token != VARIABLE) { error(EUNKNOWN); return; }
+	a=arraypayload(xc, yc, &n);
+	if (er != 0) return;
+	nexttoken();
+	if (token != TTO) { error(EUNKNOWN); return; }
+	nexttoken();
+	if (token != VARIABLE) { error(EUNKNOWN); return; }
+	b=arraypayload(xc, yc, &m);
+	if (er != 0) return;
+	if (m < n) { error(ERANGE); return; }
+	memmove(&mem[b], &mem[a], n*numsize);
+	nexttoken();
+}
+
+// the array functions, like factor() this ends on the closing bracket
+void arrayfunction(signed char t) {
+	address_t a, b, n, m, i;
+	number_t r=0, u, v;
+
+	nexttoken();
+	if (token != '(') { error(EARGS); return; }
+	nexttoken();
+	if (token != VARIABLE) { error(EARGS); return; }
+	a=arraypayload(xc, yc, &n);
+	if (er != 0) return;
+	nexttoken();
+	if (t == TDOT) {
+		if (token != ',') { error(EARGS); return; }
+		nexttoken();
+		if (token != VARIABLE) { error(EARGS); return; }
+		b=arraypayload(xc, yc, &m);
+		if (er != 0) return;
+		if (m != n) { error(ERANGE); return; }
+		nexttoken();
+	}
+	if (token != ')') { error(EARGS); return; }
+
+	switch (t) {
+		case TSUM: 
+			for (i=0; i<n; i++) { memcpy(&v, &mem[a+i*numsize], numsize); r+=v; }
+			break;
+		case TMIN:
+			memcpy(&r, &mem[a], numsize);
+			for (i=1; i<n; i++) { memcpy(&v, &mem[a+i*numsize], numsize); if (v < r) r=v; }
+			break;
+		case TMAX:
+			memcpy(&r, &mem[a], numsize);
+			for (i=1; i<n; i++) { memcpy(&v, &mem[a+i*numsize], numsize); if (v > r) r=v; }
+			break;
+		case TDOT:
+			for (i=0; i<n; i++) {
+				memcpy(&u, &mem[a+i*numsize], numsize);
+				memcpy(&v, &mem[b+i*numsize], numsize);
+				r+=u*v;
+			}
+			break;
+	}
+	push(r);
+}
+#endif
+
 
 /* 
 	
@@ -4857,7 +7085,7 @@ void dumpmem(address_t r, address_t b) {
 
 #if !defined(ARDUINO) || defined(ARDUINOSD)
 // creates a C string from a BASIC string
-void stringtobuffer(char *buffer) {
+LIBLOCAL void stringtobuffer(char *buffer) {
 	short i;
 	i=x;
 	if (i >= SBUFSIZE) i=SBUFSIZE-1;
@@ -4901,13 +7129,27 @@ void getfilename2(char * buffer, char d) {
 #endif
 
 // save a file either to disk or to EEPROM
+// SAVE "file",1 writes the binary image of the program, 
+// a 0, the letter B, the version, numsize, addrsize and top 
+// are the header followed by mem[0..top)
 void xsave() {
 	char filename[SBUFSIZE];
 	address_t here2;
+	char bimage=FALSE;
+	char header[5];
 
 	getfilename2(filename, 1);
 	if (er != 0) return;
 
+	// the optional mode argument
+	nexttoken();
+	if (token == ',') {
+		nexttoken();
+		expression();
+		if (er != 0) return;
+		bimage=(pop() == 1);
+	}
+
 	// save the output mode
 	push(od);
 
@@ -4917,12 +7159,28 @@ void xsave() {
 	 	od=OFILE;
 
 #ifndef ARDUINO
-		ofd=fopen(filename, "w");
+		ofd=fopen(filename, bimage ? "wb" : "w");
 		if (!ofd) {
+			od=pop();
 			error(EFILE);
-			nexttoken();
 			return;
 		} 
+
+		// the binary image is written in one go
+		if (bimage) {
+			header[0]=0;
+			header[1]='B';
+			header[2]=bimageversion;
+			header[3]=numsize;
+			header[4]=addrsize;
+			if (fwrite(header, 1, 5, ofd) != 5 ||
+				fwrite(&top, addrsize, 1, ofd) != 1 ||
+				fwrite(mem, 1, top, ofd) != top) error(EFILE);
+			fclose(ofd);
+			ofd=0;
+			od=pop();
+			return;
+		}
 		
 		// the core list function
 		// we step away from list 
@@ -4946,8 +7204,8 @@ void xsave() {
 #ifdef ARDUINOSD
 		ofile=SD.open(filename, FILE_WRITE);
 		if (!ofile) {
+			od=pop();
 			error(EFILE);
-			nexttoken();
 			return;
 		} 
 
@@ -4973,18 +7231,17 @@ void xsave() {
 	}
 	// restore the output mode
 	od=pop();
-
-	// and continue
-	nexttoken();
 	return;
 }
 
-// loading a file 
+// loading a file, a file starting with 0 is a binary image
 void xload() {
 	char filename[SBUFSIZE];
 	char ch;
 	address_t here2;
 	char chain = FALSE;
+	char header[5];
+	address_t t;
 
 	getfilename2(filename, 1);
 	if (er != 0) return; 
@@ -5001,6 +7258,9 @@ void xload() {
 			chain=TRUE; 
 			st=SINT; 
 			top=0;
+#ifdef HASLINEINDEX
+			lineindexclear();
+#endif
 #ifdef HASGOSUB
 			clrgosubstack();
 #endif
@@ -5009,22 +7269,82 @@ void xload() {
 #endif
 		}
 
+		// find the last line, lines behind it are simply appended
+		here=0;
+		lastline=0;
+		while (here < top) {
+			gettoken();
+			if (token == LINENUMBER) lastline=x;
+		}
+		loadlines=0;
+		loadtime=micros();
+
 #ifndef ARDUINO
 
 		if (DEBUG){ outsc("** Opening the file "); outsc(filename); outcr(); };
 
-		ifd=fopen(filename, "r");
+		ifd=fopen(filename, "rb");
 		if (!ifd) {
 			error(EFILE);
 			nexttoken();
 			return;
 		}
+
+		// the binary image replaces the program if the header fits
+		ch=fgetc(ifd);
+		ungetc(ch, ifd);
+		if (ch == 0) {
+			if (fread(header, 1, 5, ifd) != 5 || header[1] != 'B' ||
+				header[2] != bimageversion || header[3] != numsize || header[4] != addrsize ||
+				fread(&t, addrsize, 1, ifd) != 1) 
+				error(EFILE);
+			else if (t >= himem) 
+				error(EOUTOFMEMORY);
+			else if (fread(mem, 1, t, ifd) != t) {
+				top=0;
+				error(EFILE);
+			} else 
+				top=t;
+			loadtime=micros()-loadtime;
+#ifdef HASLINEINDEX
+			lineindexvalid=FALSE;
+#endif
+#ifdef HASCOMPILER
+			cvalid=FALSE;
+#endif
+#ifdef HASFORINDEX
+			forindexvalid=FALSE;
+#endif
+#ifdef HASVARINDEX
+			varindexvalid=FALSE;
+#endif
+#ifdef HASFUSE
+			fuseindexvalid=FALSE;
+#endif
+#ifdef HASFOLD
+			foldindexvalid=FALSE;
+#endif
+#ifdef HASSHORTCIRCUIT
+			skipindexvalid=FALSE;
+#endif
+			fclose(ifd);
+			ifd=0;
+			if (er != 0) return;
+			if (chain) {
+				st=SRUN;
+				here=0;
+			}
+			nexttoken();
+			return;
+		}
+
+		appendmode=TRUE;
 		while (fgets(ibuffer+1, BUFSIZE, ifd)) {
 			bi=ibuffer+1;
 			while(*bi != 0) { if (*bi == '\n' || *bi == '\r') *bi=' '; bi++; };
 				bi=ibuffer+1;
 				nexttoken();
-				if (token == NUMBER) storeline();
+				if (token == NUMBER) { storeline(); loadlines++; }
 				if (er != 0 ) break;
 		}
 		fclose(ifd);	
@@ -5038,6 +7358,7 @@ void xload() {
 			return;
 		} 
 
+		appendmode=TRUE;
     	bi=ibuffer+1;
 		while (ifile.available()) {
       		ch=ifile.read();
@@ -5050,7 +7371,7 @@ void xload() {
         		//Serial.println("After nexttoken :");
         		//Serial.println((int) token);
         		//Serial.println(x);
-        		if (token == NUMBER) storeline();
+        		if (token == NUMBER) { storeline(); loadlines++; }
         		if (er != 0 ) break;
         		bi=ibuffer+1;
       		} else {
@@ -5064,6 +7385,9 @@ void xload() {
 		ifile.close();
 #endif
 #endif
+		appendmode=FALSE;
+		loadtime=micros()-loadtime;
+
 		// go back to run mode and start from the first line
 		if (chain) {
 			st=SRUN;
@@ -5208,6 +7532,52 @@ void xset(){
 					break;
 			}		
 			break;	
+#ifdef HASCOMPILER
+		case 6: // compile programs on RUN
+			cmode=(arg != 0);
+			break;
+#endif
+#ifdef HASOUTBUFFER
+		case 7: // flush the console output, 0 switches buffering off
+			outflush();
+			obuffered=(arg != 0);
+			break;
+#endif
+#ifdef HASPROFILER
+		case 8: // profile the lines from the next RUN on
+			profiling=(arg != 0);
+			break;
+#endif
+#ifdef HASFOLD
+		case 14: // use the values of expressions of numbers only
+			folding=(arg != 0);
+			break;
+#endif
+#ifdef HASPRATT
+		case 15: // 1 is the one loop evaluator, 0 the recursive descent
+			prattmode=(arg != 0);
+			break;
+#endif
+#ifdef HASSHORTCIRCUIT
+		case 16: // AND and OR only evaluate their right side if needed
+			shortcircuit=(arg != 0);
+			break;
+#endif
+#ifdef HASBUDGET
+		case 12: // the statements of every RUN and CONT, 0 is unlimited
+			budgetlimit=arg;
+			break;
+		case 13: // the milliseconds of every RUN and CONT, 0 is unlimited
+			timelimit=arg;
+			break;
+#endif
+#ifdef HASDYNSTACKS
+		case 9: // resize the arithmetic, gosub and for stack
+		case 10:
+		case 11:
+			stackresize(fn-9, arg);
+			break;
+#endif
 	}
 }
 
@@ -5292,7 +7662,7 @@ void xtone(){
 #ifdef HASFILEIO
 
 // string equal helper in catalog 
-char streq(char *s, char *m){
+LIBLOCAL char streq(char *s, char *m){
 	short i=0;
 	while (m[i]!=0 && s[i]!=0 && i < SBUFSIZE){
 		if (s[i] != m[i]) return 0;
@@ -5445,8 +7815,10 @@ void xclose() {
 #ifndef ARDUINO
 	if (mode == 1) {
 		if (ofd) fclose(ofd);
+		ofd=0;
 	} else if (mode == 0) {
 		if (ifd) fclose(ifd);
+		ifd=0;
 	}
 #else 
 #ifdef ARDUINOSD
@@ -5471,6 +7843,7 @@ void xclose() {
 
 	Implemented call vectors
 		1: Serial code
+		9: counters of the runtime caches
 
 */
 
@@ -5488,13 +7861,17 @@ void xusr() {
 				case 0: push(numsize); break;
 				case 1: push(maxnum); break;
 				case 2: push(addrsize); break;
-				case 3: push(maxaddr); break;
+				case 3: push((unsigned long) maxaddr > (unsigned long) maxnum ? maxnum : maxaddr); break;
 				case 4: push(strindexsize); break;
 				case 5: push(memsize+1); break;
 				case 6: push(elength()); break;
-				case 7: push(GOSUBDEPTH); break;
-				case 8: push(FORDEPTH); break;
-				case 9: push(STACKSIZE); break;
+#ifdef HASGOSUB
+				case 7: push(gosubdepth); break;
+#endif
+#ifdef HASFORNEXT
+				case 8: push(fordepth); break;
+#endif
+				case 9: push(stacksize); break;
 				case 10: push(BUFSIZE); break;
 				case 11: push(SBUFSIZE); break;
 				case 12: push(serial_baudrate); break;
@@ -5537,7 +7914,7 @@ void xusr() {
 			push(bfind(instr[1], instr[2], instr[3]));
 			break;	
 		case 4: // more evil - allocate an arbitrary object on the heap
-			push(bmalloc(instr[1], instr[2], instr[3], arg));
+			push(bmalloc(instr[1], instr[2], instr[3], arg, 1));
 			break;
 		case 5: // find the length of an object on the heap
 			push(blength(instr[1], instr[2], instr[3]));
@@ -5561,6 +7938,45 @@ void xusr() {
 			st=pop();			// go back to run mode
 			push(0);
 			break;
+		case 9: // counters of the runtime caches
+			switch(arg) {
+#ifdef HASLINEINDEX
+				case 0: push(lineindexhits); break;
+				case 1: push(lineindexmisses); break;
+#endif
+#ifdef HASCOMPILER
+				case 2: push(cvalid ? ncode : 0); break;
+				case 3: push(cfallbacks); break;
+#endif
+				case 4: push(loadtime); break;
+				case 5: push(loadlines); break;
+#ifdef HASPROFILER
+				case 6: push(profilecount); break;
+				case 7: push(profilefree); break;
+#endif
+#ifdef HASFORINDEX
+				case 8: push(forindexhits); break;
+				case 9: push(forindexmisses); break;
+#endif
+#ifdef HASBUDGET
+				case 10: push(budgetstop); break;
+#endif
+#ifdef HASVARINDEX
+				case 11: push(varindexhits); break;
+				case 12: push(varindexmisses); break;
+#endif
+#ifdef HASFUSE
+				case 13: push(fusecount); break;
+#endif
+#ifdef HASFOLD
+				case 14: push(foldhits); break;
+#endif
+#ifdef HASSHORTCIRCUIT
+				case 15: push(skipcount); break;
+#endif
+				default: push(0);
+			}
+			break;
 		default: push(0);
 	}
 }
@@ -5571,27 +7987,1041 @@ void xcall() {
 	nexttoken();
 }
 
-
 /* 
 
-	statement processes an entire basic statement until the end 
-	of the line. 
+	The compiler translates the program in mem on RUN into code 
+	for a small stack machine. Numbers are decoded, single letter 
+	variables resolved to their slot in vars and jump targets of 
+	GOTO, GOSUB, IF and FOR resolved to code offsets. Statements 
+	the compiler doesn't know are kept as a CSTMT and run by 
+	statement(). mem is not changed, LIST and SAVE see the program 
+	as it was entered.
 
-	The statement loop is a bit odd and requires some explanation.
-	A statement function called in the central switch here must either
-	call nexttoken as its last action to feed the loop with a new token 
-	and then break or it must return which means that the rest of the 
-	line is ignored. A function that doesn't call nexttoken and just 
-	breaks causes an infinite loop.
+	The code uses the interpreter stacks. FOR and GOSUB store mem 
+	addresses like the interpreter, cstmt maps them back to the 
+	code. Whenever the code cannot continue, crun() returns with 
+	here and token set and the interpreter takes over. 
+
+	Every program change invalidates the code. Programs with RUN, 
+	CONT, NEW or LOAD are not compiled.
 
 */
 
-void statement(){
-	if (DEBUG) debug("statement \n"); 
-	while (token != EOL) {
-		switch(token){
-			case LINENUMBER:
-				nexttoken();
+#ifdef HASCOMPILER
+
+// the instructions of the stack machine
+#define CHALT	0
+#define CNUM	1
+#define CVAR	2
+#define CGETV	3
+#define CSETVAR	4
+#define CSETV	5
+#define CGETA	6
+#define CSETA	7
+#define CADD	8
+#define CSUB	9
+#define CMUL	10
+#define CDIV	11
+#define CMOD	12
+#define CEQ		13
+#define CNE		14
+#define CGT		15
+#define CLT		16
+#define CGE		17
+#define CLE		18
+#define CNOT	19
+#define CAND	20
+#define COR		21
+#define CCALL	22
+#define CSIZE	23
+#define CHIMEM	24
+#define CJMP	25
+#define CJZ		26
+#define CGOTO	27
+#define CGOTOX	28
+#define CGOSUB	29
+#define CGOSUBJ	30
+#define CGOSUBX	31
+#define CRETURN	32
+#define CFOR	33
+#define CNEXT	34
+#define CEND	35
+#define CSTMT	36
+
+void ccompile() {
+	free(ccode);
+	free(cstmt);
+	free(clines);
+
+	// every token makes at most two instructions
+	if (2*(long)top+2 < maxaddr) csize=2*top+2; else csize=maxaddr-1;
+	ccode=malloc(csize*sizeof(*ccode));
+	cstmt=malloc((top+1)*sizeof(*cstmt));
+	clines=malloc((top/(addrsize+1)+1)*sizeof(*clines));
+	if (ccode == NULL || cstmt == NULL || clines == NULL) { csize=0; return; }
+
+	ncode=0;
+	ncstmt=0;
+	nclines=0;
+	cfixup=maxaddr;
+	cmaxdepth=0;
+	cfallbacks=0;
+	cfail=0;
+
+	here=0;
+	while (here < top) {
+		gettoken();
+		if (token == TRUN || token == TCONT || token == TNEW || token == TLOAD) return;
+	}
+
+	here=0;
+	cnext();
+	while (token != EOL) {
+		if (token == LINENUMBER || token == ':') {
+			if (token == LINENUMBER) {
+				cresolve();
+				clines[nclines].l=x;
+				clines[nclines++].pc=ncode;
+			}
+			cstmt[ncstmt].a=here;
+			cstmt[ncstmt++].pc=ncode;
+			cnext();
+		} else {
+			cstatement();
+			if (cfail) return;
+		}
+	}
+
+	cresolve();
+	if (ncstmt == 0 || cstmt[ncstmt-1].a != top) {
+		cstmt[ncstmt].a=top;
+		cstmt[ncstmt++].pc=ncode;
+	}
+	cemit(CHALT, 0);
+	if (cfail) return;
+
+	clink();
+	cvalid=TRUE;
+}
+
+// one statement, if it cannot be compiled it is left to statement()
+void cstatement() {
+	address_t a=ca;
+	address_t n0=ncode;
+
+	cfail=0;
+	cdepth=0;
+	switch (token) {
+		case TLET:
+			cnext();
+			if (token != VARIABLE && token != ARRAYVAR) { cfail=1; break; }
+		case VARIABLE:
+		case ARRAYVAR:
+			cassignment();
+			break;
+		case TGOTO:
+#ifdef HASGOSUB
+		case TGOSUB:
+#endif
+			cgoto();
+			break;
+#ifdef HASGOSUB
+		case TRETURN:
+			cemit(CRETURN, 0);
+			cnext();
+			break;
+#endif
+		case TIF:
+			cif();
+			break;
+#ifdef HASFORNEXT
+		case TFOR:
+			cfor();
+			break;
+		case TNEXT:
+			cnextloop();
+			break;
+#endif
+		case TSTOP:
+		case TEND:
+			cemit(CEND, 0);
+			cnext();
+			break;
+		case TREM:
+			while (token != LINENUMBER && token != EOL) cnext();
+			break;
+		default:
+			cfail=1;
+	}
+	if (cfail == 1 || cdepth > stacksize) {
+		ncode=n0;
+		here=a;
+		cnext();
+		while (token != ':' && token != LINENUMBER && token != EOL) cnext();
+		cfail=0;
+		cemit(CSTMT, here);
+		ccode[ncode-1].a=a;
+		cfallbacks++;
+		return;
+	}
+	if (cdepth > cmaxdepth) cmaxdepth=cdepth;
+}
+
+void cassignment() {
+	char xcl=xc;
+	char ycl=yc;
+	signed char t=token;
+
+	cnext();
+	if (t == ARRAYVAR) {
+		if (csubscripts() != 1) cfail=1;
+		if (cfail) return;
+		cnext();
+	}
+	if (token != '=') { cfail=1; return; }
+	cnext();
+	cexpression();
+	if (cfail) return;
+	if (! termsymbol()) { cfail=1; return; }
+
+	xc=xcl;
+	yc=ycl;
+	if (t == ARRAYVAR) {
+		cemit(CSETA, 0);
+		cstack(-2);
+	} else {
+		if (xc >= 'A' && xc <= 'Z' && yc == 0) cemit(CSETVAR, xc-'A'); else cemit(CSETV, 0);
+		cstack(-1);
+	}
+}
+
+// constant targets are resolved by clink()
+void cgoto() {
+	signed char t=token;
+	address_t n0;
+
+	cnext();
+	n0=ncode;
+	cexpression();
+	if (cfail) return;
+	if (t == TGOSUB && ! termsymbol()) { cfail=1; return; }
+
+	if (ncode == n0+1 && ccode[n0].op == CNUM) {
+		ncode=n0;
+		cemit(t == TGOSUB ? CGOSUB : CGOTO, ccode[n0].n);
+	} else 
+		cemit(t == TGOSUB ? CGOSUBX : CGOTOX, 0);
+	ccode[ncode-1].a=here;
+	cstack(-1);
+}
+
+// a false condition jumps to the next line, cresolve() patches it
+void cif() {
+	cnext();
+	cexpression();
+	if (cfail) return;
+
+	cemit(CJZ, cfixup);
+	cfixup=ncode-1;
+	cstack(-1);
+
+	if (token == TTHEN) {
+		cnext();
+		if (token == NUMBER) {
+			cemit(CGOTO, x);
+			cnext();
+		}
+	}
+}
+
+// the FOR jumps behind its NEXT if the loop is not entered
+void cfor() {
+	char xcl, ycl;
+	short f=0;
+	address_t h;
+	number_t n=-1;
+
+	cnext();
+	if (token != VARIABLE) { cfail=1; return; }
+	xcl=xc;
+	ycl=yc;
+	cnext();
+	if (token != '=') { cfail=1; return; }
+	cnext();
+	cexpression();
+	if (cfail) return;
+	if (xcl >= 'A' && xcl <= 'Z' && ycl == 0) cemit(CSETVAR, xcl-'A'); else cemit(CSETV, 0);
+	ccode[ncode-1].c=xcl;
+	ccode[ncode-1].d=ycl;
+	cstack(-1);
+
+	if (token != TTO) { cfail=1; return; }
+	cnext();
+	cexpression();
+	if (cfail) return;
+	if (token == TSTEP) {
+		cnext();
+		cexpression();
+		if (cfail) return;
+	} else {
+		cemit(CNUM, 1);
+		cstack(1);
+	}
+	if (! termsymbol()) { cfail=1; return; }
+
+	// search the NEXT like findnext() does
+	h=ca;
+	while (TRUE) {
+		if (token == TNEXT) {
+			if (f == 0) break; else f--;
+		}
+		if (token == TFOR) f++;
+		if (here >= top) break;
+		gettoken();
+	}
+	if (token == TNEXT) {
+		gettoken();
+		if (token == ':' || token == LINENUMBER || token == EOL) n=here;
+	}
+	here=h;
+	cnext();
+
+	xc=xcl;
+	yc=ycl;
+	cemit(CFOR, n);
+	ccode[ncode-1].a=here;
+	cstack(-2);
+}
+
+void cnextloop() {
+	char xcl=0;
+	char ycl=0;
+
+	cnext();
+	if (token == VARIABLE) {
+		xcl=xc;
+		ycl=yc;
+		cnext();
+	}
+	if (! termsymbol()) { cfail=1; return; }
+	xc=xcl;
+	yc=ycl;
+	cemit(CNEXT, 0);
+}
+
+/*
+	the expression compiler follows the recursive descent 
+	parser in expression() and keeps its associativity
+*/
+
+void cexpression() {
+	candexpression();
+	if (cfail) return;
+	if (token == TOR) {
+		cnext();
+		cexpression();
+		if (cfail) return;
+		cemit(COR, 0);
+		cstack(-1);
+	}
+}
+
+void candexpression() {
+	cnotexpression();
+	if (cfail) return;
+	if (token == TAND) {
+		cnext();
+		cexpression();
+		if (cfail) return;
+		cemit(CAND, 0);
+		cstack(-1);
+	}
+}
+
+void cnotexpression() {
+	if (token == TNOT) {
+		cnext();
+		ccompexpression();
+		if (cfail) return;
+		cemit(CNOT, 0);
+	} else 
+		ccompexpression();
+}
+
+void ccompexpression() {
+	signed char o;
+
+	caddexpression();
+	if (cfail) return;
+	switch (token) {
+		case '=': o=CEQ; break;
+		case NOTEQUAL: o=CNE; break;
+		case '>': o=CGT; break;
+		case '<': o=CLT; break;
+		case GREATEREQUAL: o=CGE; break;
+		case LESSEREQUAL: o=CLE; break;
+		default: return;
+	}
+	cnext();
+	ccompexpression();
+	if (cfail) return;
+	cemit(o, 0);
+	cstack(-1);
+}
+
+void caddexpression() {
+	signed char o;
+
+	if (token != '+' && token != '-') {
+		cterm();
+		if (cfail) return;
+	} else {
+		cemit(CNUM, 0);
+		cstack(1);
+	}
+
+	while (token == '+' || token == '-') {
+		if (token == '+') o=CADD; else o=CSUB;
+		cnext();
+		cterm();
+		if (cfail) return;
+		cemit(o, 0);
+		cstack(-1);
+	}
+}
+
+void cterm() {
+	signed char o;
+
+	cfactor();
+	if (cfail) return;
+	while (TRUE) {
+		cnext();
+		if (token == '*') o=CMUL;
+		else if (token == '/') o=CDIV;
+		else if (token == '%') o=CMOD;
+		else return;
+		cnext();
+		cfactor();
+		if (cfail) return;
+		cemit(o, 0);
+		cstack(-1);
+	}
+}
+
+// like factor() this ends on the last token of the factor
+void cfactor() {
+	char xcl, ycl;
+
+	switch (token) {
+		case NUMBER:
+			cemit(CNUM, x);
+			cstack(1);
+			break;
+		case VARIABLE:
+			if (xc >= 'A' && xc <= 'Z' && yc == 0) cemit(CVAR, xc-'A'); else cemit(CGETV, 0);
+			cstack(1);
+			break;
+		case ARRAYVAR:
+			xcl=xc;
+			ycl=yc;
+			cnext();
+			if (csubscripts() != 1) cfail=1;
+			if (cfail) return;
+			xc=xcl;
+			yc=ycl;
+			cemit(CGETA, 0);
+			break;
+		case '(':
+			cnext();
+			cexpression();
+			if (cfail) return;
+			if (token != ')') cfail=1;
+			break;
+		case TABS: 
+			cfunction(xabs, 1);
+			break;
+		case TRND: 
+			cfunction(rnd, 1);
+			break;
+		case TSIZE:
+			cemit(CSIZE, 0);
+			cstack(1);
+			break;
+#ifdef HASAPPLE1
+		case TSGN: 
+			cfunction(xsgn, 1);
+			break;
+		case TPEEK: 
+			cfunction(peek, 1);
+			break;
+		case TLOMEM:
+			cemit(CNUM, 0);
+			cstack(1);
+			break;
+		case THIMEM:
+			cemit(CHIMEM, 0);
+			cstack(1);
+			break;
+#endif
+#ifdef HASSTEFANSEXT
+		case TSQR: 
+			cfunction(sqr, 1);
+			break;
+		case TFRE: 
+			cfunction(xfre, 1);
+			break;
+		case TUSR: // USR(8, ...) changes the program and is left to statement()
+			if (mem[here] != '(' || mem[here+1] != NUMBER || mem[here+numsize+2] != ',') { cfail=1; return; }
+			getnumber(here+2, numsize);
+			if (z.i == 8) { cfail=1; return; }
+			cfunction(xusr, 2);
+			break;
+#endif
+#ifdef HASARDUINOIO
+		case TAREAD: 
+			cfunction(aread, 1);
+			break;
+		case TDREAD: 
+			cfunction(dread, 1);
+			break;
+		case TMILLIS: 
+			cfunction(bmillis, 1);
+			break;	
+#ifdef HASPULSE
+		case TPULSEIN:
+			cfunction(bpulsein, 3);
+			break;
+#endif
+		case TAZERO:
+			cemit(CNUM, 0);
+			cstack(1);
+			break;
+#endif
+		default:
+			cfail=1;
+	}
+}
+
+void cfunction(void (*f)(), short ae) {
+	cnext();
+	if (csubscripts() != ae) cfail=1;
+	if (cfail) return;
+	cemit(CCALL, 0);
+	ccode[ncode-1].f=f;
+	cstack(1-ae);
+}
+
+short carguments() {
+	short args=0;
+
+	if (termsymbol()) return args;
+	while (TRUE) {
+		cexpression();
+		if (cfail) return 0;
+		args++;
+		if (token != ',') return args;
+		cnext();
+	}
+}
+
+short csubscripts() {
+	short args;
+
+	if (token != '(') return 0;
+	cnext();
+	args=carguments();
+	if (cfail) return 0;
+	if (token != ')') { cfail=1; return 0; }
+	return args;
+}
+
+// ca is the address of the token
+void cnext() {
+	ca=here;
+	gettoken();
+}
+
+void cemit(signed char o, number_t n) {
+	if (ncode >= csize) { cfail=2; return; }
+	ccode[ncode].op=o;
+	ccode[ncode].c=xc;
+	ccode[ncode].d=yc;
+	ccode[ncode].a=ca;
+	ccode[ncode].n=n;
+	ncode++;
+}
+
+// the stack depth the interpreter would need
+void cstack(short d) {
+	cdepth+=d;
+	if (cdepth > cmaxdepth) cmaxdepth=cdepth;
+}
+
+// the pending jumps of false IFs go to here
+void cresolve() {
+	address_t i;
+
+	while (cfixup != maxaddr) {
+		i=ccode[cfixup].n;
+		ccode[cfixup].n=ncode;
+		cfixup=i;
+	}
+}
+
+void clink() {
+	address_t i, pc;
+
+	for (i=0; i<ncode; i++) {
+		switch (ccode[i].op) {
+			case CGOTO:
+				pc=clinefind(ccode[i].n);
+				if (pc != maxaddr) { ccode[i].op=CJMP; ccode[i].n=pc; }
+				break;
+			case CGOSUB:
+				pc=clinefind(ccode[i].n);
+				if (pc != maxaddr) { ccode[i].op=CGOSUBJ; ccode[i].n=pc; }
+				break;
+			case CFOR:
+				if (ccode[i].n != -1) {
+					pc=cfind(ccode[i].n);
+					if (pc != maxaddr) ccode[i].n=pc; else ccode[i].n=-1;
+				}
+				break;
+		}
+	}
+}
+
+// the code of a statement address, maxaddr if there is none
+address_t cfind(address_t a) {
+	address_t i=0;
+	address_t j=ncstmt;
+	address_t m;
+
+	while (i < j) {
+		m=(i+j)/2;
+		if (cstmt[m].a < a) i=m+1; else j=m;
+	}
+	if (i < ncstmt && cstmt[i].a == a) return cstmt[i].pc; else return maxaddr;
+}
+
+address_t clinefind(address_t l) {
+	address_t i=0;
+	address_t j=nclines;
+	address_t m;
+
+	while (i < j) {
+		m=(i+j)/2;
+		if (clines[m].l < l) i=m+1; else j=m;
+	}
+	if (i < nclines && clines[i].l == l) return clines[i].pc; else return maxaddr;
+}
+
+// a mem address in the statement running at cpc, for error() 
+address_t cposition() {
+	address_t i=0;
+	address_t j=ncstmt;
+	address_t m;
+
+	while (i < j) {
+		m=(i+j)/2;
+		if (cstmt[m].pc <= cpc) i=m+1; else j=m;
+	}
+	if (i == 0) return 0; else return cstmt[i-1].a+1;
+}
+
+/*
+	the code runner starts at the statement at address a, 
+	a=0 is the start of the program
+*/
+
+void crun(address_t a) {
+	address_t pc;
+	struct ccell *c;
+	number_t t;
+
+#ifdef HASBUDGET
+	if (budgeting) return;
+#endif
+	if (a == 0) pc=0; else pc=cfind(a);
+	if (pc == maxaddr || sp+cmaxdepth > stacksize) return;
+
+	crunning=TRUE;
+	while (TRUE) {
+		cpc=pc;
+		c=ccode+pc++;
+		switch (c->op) {
+			case CNUM:
+				stack[sp++]=c->n;
+				break;
+			case CVAR:
+				stack[sp++]=vars[(int) c->n];
+				break;
+			case CGETV:
+				t=getvar(c->c, c->d);
+				if (er != 0) goto stop;
+				stack[sp++]=t;
+				break;
+			case CSETVAR:
+				vars[(int) c->n]=stack[--sp];
+				break;
+			case CSETV:
+				setvar(c->c, c->d, stack[--sp]);
+				if (er != 0) goto stop;
+				break;
+			case CGETA:
+				array('g', c->c, c->d, stack[sp-1], &y);
+				if (er != 0) goto stop;
+				stack[sp-1]=y;
+				break;
+			case CSETA:
+				sp-=2;
+				array('s', c->c, c->d, stack[sp], &stack[sp+1]);
+				if (er != 0) goto stop;
+				break;
+			case CADD:
+				sp--;
+				stack[sp-1]+=stack[sp];
+				break;
+			case CSUB:
+				sp--;
+				stack[sp-1]-=stack[sp];
+				break;
+			case CMUL:
+				sp--;
+				stack[sp-1]*=stack[sp];
+				break;
+			case CDIV:
+				sp--;
+				if (stack[sp] == 0) { error(EDIVIDE); goto stop; }
+				stack[sp-1]/=stack[sp];
+				break;
+			case CMOD:
+				sp--;
+				if (stack[sp] == 0) { error(EDIVIDE); goto stop; }
+#ifndef HASFLOAT
+				stack[sp-1]%=stack[sp];
+#else 
+				stack[sp-1]=(int)stack[sp-1]%(int)stack[sp];
+#endif
+				break;
+			case CEQ:
+				sp--;
+				stack[sp-1]=(stack[sp-1] == stack[sp]);
+				break;
+			case CNE:
+				sp--;
+				stack[sp-1]=(stack[sp-1] != stack[sp]);
+				break;
+			case CGT:
+				sp--;
+				stack[sp-1]=(stack[sp-1] > stack[sp]);
+				break;
+			case CLT:
+				sp--;
+				stack[sp-1]=(stack[sp-1] < stack[sp]);
+				break;
+			case CGE:
+				sp--;
+				stack[sp-1]=(stack[sp-1] >= stack[sp]);
+				break;
+			case CLE:
+				sp--;
+				stack[sp-1]=(stack[sp-1] <= stack[sp]);
+				break;
+			case CNOT:
+				stack[sp-1]=! stack[sp-1];
+				break;
+			case CAND:
+				sp--;
+				stack[sp-1]=(stack[sp-1] && stack[sp]);
+				break;
+			case COR:
+				sp--;
+				stack[sp-1]=(stack[sp-1] || stack[sp]);
+				break;
+			case CCALL:
+				c->f();
+				if (er != 0) goto stop;
+				break;
+			case CSIZE:
+				stack[sp++]=himem-top;
+				break;
+			case CHIMEM:
+				stack[sp++]=himem;
+				break;
+			case CJMP:
+				pc=c->n;
+				break;
+			case CJZ:
+				if (! stack[--sp]) pc=c->n;
+				break;
+			case CGOTOX:
+			case CGOTO:
+				if (c->op == CGOTOX) t=stack[--sp]; else t=c->n;
+				pc=clinefind(t);
+				if (pc == maxaddr) { error(ELINE); goto stop; }
+				break;
+#ifdef HASGOSUB
+			case CGOSUBX:
+			case CGOSUB:
+			case CGOSUBJ:
+				if (c->op == CGOSUBX) t=stack[--sp]; else t=c->n;
+				here=c->a;
+				pushgosubstack();
+				if (er != 0) goto stop;
+				cgosubcache[gosubsp-1].a=here;
+				cgosubcache[gosubsp-1].pc=pc;
+				if (c->op == CGOSUBJ) pc=t; else pc=clinefind(t);
+				if (pc == maxaddr) { error(ELINE); goto stop; }
+				break;
+			case CRETURN:
+				popgosubstack();
+				if (er != 0) goto stop;
+				if (cgosubcache[gosubsp].a == here) pc=cgosubcache[gosubsp].pc; else pc=cfind(here);
+				if (pc == maxaddr) { gettoken(); goto stop; }
+				break;
+#endif
+#ifdef HASFORNEXT
+			case CFOR:
+				y=stack[--sp];
+				x=stack[--sp];
+				xc=c->c;
+				yc=c->d;
+				here=c->a;
+				pushforstack();
+				if (er != 0) goto stop;
+				cforcache[forsp-1].a=here;
+				cforcache[forsp-1].pc=pc;
+				t=getvar(xc, yc);
+				if ( (y > 0 && t > x) || (y < 0 && t < x) ) {
+					dropforstack();
+					if (c->n != -1) { pc=c->n; break; }
+					crunning=FALSE;
+					token=':';
+					findnext();
+					if (er != 0) goto stop;
+					nexttoken();
+					goto stop;
+				}
+				break;
+			case CNEXT:
+				if (forsp == 0) { error(EFOR); goto stop; }
+				if (c->c && (c->c != forstack[forsp-1].varx || c->d != forstack[forsp-1].vary)) {
+					forsp--;
+					error(EFOR); 
+					goto stop; 
+				}
+				y=forstack[forsp-1].step;
+				if (y != 0) {
+					t=getvar(forstack[forsp-1].varx, forstack[forsp-1].vary)+y;
+					setvar(forstack[forsp-1].varx, forstack[forsp-1].vary, t);
+					if (er != 0) goto stop;
+					x=forstack[forsp-1].to;
+					if ( (y > 0 && t > x) || (y < 0 && t < x) ) {
+						forsp--;
+						break;
+					}
+				}
+				here=forstack[forsp-1].here;
+				if (cforcache[forsp-1].a == here) pc=cforcache[forsp-1].pc; else pc=cfind(here);
+				if (pc == maxaddr) { gettoken(); goto stop; }
+				break;
+#endif
+			case CEND:
+				here=c->a+1;
+				token=TEND;
+				*ibuffer=0;
+				st=SINT;
+				goto stop;
+			case CSTMT:
+				crunning=FALSE;
+				here=c->a;
+				gettoken();
+				cstep=TRUE;
+				statement();
+				cstep=FALSE;
+				if (er != 0 || st != SRUN || ! cvalid || here >= top) goto stop;
+				if (here != c->n) pc=cfind(here);
+				if (pc == maxaddr || sp+cmaxdepth > STACKSIZE) goto stop;
+				crunning=TRUE;
+				break;
+			case CHALT:
+			default:
+				here=top;
+				token=EOL;
+				goto stop;
+		}
+	}
+
+stop:
+	crunning=FALSE;
+}
+#endif
+
+
+/*
+
+	The profiler attributes the statements run from memory and 
+	the time until the next statement to the line they are on. 
+	The clock is the one of MILLIS in microseconds. PROFILE n 
+	lists the n lines with the most time, 10 if n is omitted. 
+	Compiled code is not run while profiling.
+
+*/
+
+#ifdef HASPROFILER
+// the table has at least twice as many slots as the program has lines
+void profileclear() {
+	address_t i, n=0;
+	address_t here2=here;
+
+	here=0;
+	while (here < top) {
+		gettoken();
+		if (token == LINENUMBER) n++;
+	}
+	here=here2;
+
+	for (i=16; i/2 < n; i*=2);
+	if (i > profilesize) {
+		free(profile);
+		profile=malloc(i*sizeof(*profile));
+		if (!profile) { profilesize=0; profiling=FALSE; error(EOUTOFMEMORY); return; }
+		profilesize=i;
+	}
+	for (i=0; i<profilesize; i++) { profile[i].l=0; profile[i].n=0; profile[i].t=0; }
+	profileused=0;
+	profileslot=profilesize;
+	profilecount=0;
+	profilefree=himem-top;
+}
+
+// the slot of line l or the free slot where it belongs
+address_t profileslotof(address_t l) {
+	address_t i=(l*31) & (profilesize-1);
+
+	while (profile[i].l != 0 && profile[i].l != l) i=(i+1) & (profilesize-1);
+	return i;
+}
+
+// the slot of line l, lines are added while the table is half empty
+address_t profilefind(address_t l) {
+	address_t i=profileslotof(l);
+
+	if (profile[i].l == 0) {
+		if (2*(profileused+1) > profilesize) return profilesize;
+		profile[i].l=l;
+		profileused++;
+	}
+	return i;
+}
+
+void profilestatement() {
+	unsigned long t;
+
+	if (st != SRUN || !profilesize || token == LINENUMBER || token == ':') return;
+	t=micros();
+	if (profileslot != profilesize) profile[profileslot].t+=t-profiletime;
+	profileslot=profilefind(myline(here));
+	if (profileslot != profilesize) profile[profileslot].n++;
+	profilecount++;
+	if (himem-top < profilefree) profilefree=himem-top;
+	profiletime=t;
+}
+
+void profilestop() {
+	if (profilesize && profileslot != profilesize) profile[profileslot].t+=micros()-profiletime;
+	profileslot=profilesize;
+}
+
+void xprofile() {
+	address_t n=10;
+	address_t i, j, l, pl, a, here2, ln;
+	unsigned long t, pt;
+	signed char t2;
+
+	nexttoken();
+	if (!termsymbol()) {
+		expression();
+		if (er != 0) return;
+		n=pop();
+	}
+	if (!profilesize) return;
+	here2=here;
+	t2=token;
+
+	// lines sorted by time, then by line number
+	pl=0;
+	pt=0;
+	for (i=0; i<n; i++) {
+		l=0;
+		t=0;
+		a=0;
+		here=0;
+		while (here < top) {
+			gettoken();
+			if (token != LINENUMBER) continue;
+			ln=x;
+			j=profileslotof(ln);
+			if (profile[j].n == 0) continue;
+			if (i > 0 && (profile[j].t > pt || (profile[j].t == pt && ln <= pl))) continue;
+			if (l == 0 || profile[j].t > t || (profile[j].t == t && ln < l)) {
+				l=ln;
+				t=profile[j].t;
+				a=here-addrsize-1;
+			}
+		}
+		if (l == 0) break;
+		outnumber(t); outspc(); 
+		outnumber(profile[profileslotof(l)].n); outspc();
+		here=a;
+		gettoken();
+		do {
+			outputtoken();
+			gettoken();
+		} while (token != LINENUMBER && token != EOL);
+		outcr();
+		pl=l;
+		pt=t;
+	}
+	here=here2;
+	token=t2;
+}
+#endif
+
+/* 
+
+	statement processes an entire basic statement until the end 
+	of the line. 
+
+	The statement loop is a bit odd and requires some explanation.
+	A statement function called in the central switch here must either
+	call nexttoken as its last action to feed the loop with a new token 
+	and then break or it must return which means that the rest of the 
+	line is ignored. A function that doesn't call nexttoken and just 
+	breaks causes an infinite loop.
+
+	Compiled code runs single statements here with cstep set. 
+	statement then returns at the next statement boundary.
+
+*/
+
+void statement(){
+	if (DEBUG) debug("statement \n"); 
+	while (token != EOL) {
+#ifdef HASBUDGET
+		if (budgeting && budgetcheck()) return;
+#endif
+#ifdef HASPROFILER
+		if (profiling) profilestatement();
+#endif
+		switch(token){
+			case LINENUMBER:
+#ifdef HASCOMPILER
+				if (cstep) return;
+#endif
+				nexttoken();
 				break;
 // Palo Alto BASIC language set + BREAK
 			case TPRINT:
@@ -5606,6 +9036,9 @@ void statement(){
 			case STRINGVAR:
 			case ARRAYVAR:
 			case VARIABLE:		
+#ifdef HASFUSE
+				if (token == VARIABLE && st == SRUN && fusestatement()) break;
+#endif
 				assignment();
 				break;
 			case TINPUT:
@@ -5618,9 +9051,15 @@ void statement(){
 			case TGOSUB:
 #endif
 			case TGOTO:
+#ifdef HASFUSE
+				if (st == SRUN && fusestatement()) break;
+#endif
 				xgoto();	
 				break;
 			case TIF:
+#ifdef HASFUSE
+				if (st == SRUN && fusestatement()) break;
+#endif
 				xif();
 				break;
 #ifdef HASFORNEXT
@@ -5731,11 +9170,27 @@ void statement(){
 			case TCALL:
 				xcall();
 				break;	
+#ifdef HASPROFILER
+			case TPROFILE:
+				xprofile();
+				break;
+#endif
+#ifdef HASARRAYOPS
+			case TFILL:
+				xfill();
+				break;
+			case TCOPY:
+				xcopy();
+				break;
+#endif
 // and all the rest
 			case UNKNOWN:
 				error(EUNKNOWN);
 				return;
 			case ':':
+#ifdef HASCOMPILER
+				if (cstep) return;
+#endif
 				nexttoken();
 				break;
 			default: // very tolerant - tokens are just skipped 
@@ -5748,17 +9203,514 @@ void statement(){
 	}
 }
 
+/*
+	The interpreter contexts. basiccreate() makes an interpreter 
+	with n bytes of memory and the stack sizes of the command line, 
+	basicrun() runs one line of input in it like loop() and 
+	basicdestroy() frees it. 
+*/
+
+#ifdef HASCONTEXT
+// exchange the bytes of a variable with its copy in the context 
+LIBLOCAL void cswap(void* a, void* b, size_t n) {
+	char t;
+	char* p=a;
+	char* q=b;
+
+	while (n-- > 0) { t=*p; *p++=*q; *q++=t; }
+}
+
+#define CSWAP(v) cswap(&v, &c->v, sizeof(v))
+
+void contextswap(struct basiccontext* c) {
+	CSWAP(mem); CSWAP(himem); CSWAP(memsize);
+	CSWAP(stack); CSWAP(stacksize); CSWAP(sp);
+	CSWAP(ibuffer); CSWAP(bi);
+	CSWAP(vars);
+#ifdef HASFORNEXT
+	CSWAP(forstack); CSWAP(fordepth); CSWAP(forsp); CSWAP(fnc);
+#endif
+#ifdef HASGOSUB
+	CSWAP(gosubstack); CSWAP(gosubdepth); CSWAP(gosubsp);
+#endif
+	CSWAP(appendmode); CSWAP(lastline); CSWAP(loadtime); CSWAP(loadlines);
+#ifdef HASLINEINDEX
+	CSWAP(lineindex); CSWAP(lineindexsize); CSWAP(nlines); CSWAP(lineindexvalid);
+	CSWAP(lineindexlast); CSWAP(lineindexhits); CSWAP(lineindexmisses);
+#endif
+#ifdef HASFORINDEX
+	CSWAP(forindex); CSWAP(forindexsize); CSWAP(forindexused); CSWAP(forindexvalid);
+	CSWAP(forindexhits); CSWAP(forindexmisses);
+#endif
+#ifdef HASVARINDEX
+	CSWAP(varindex); CSWAP(varindexsize); CSWAP(varindexvalid);
+	CSWAP(varindexhits); CSWAP(varindexmisses);
+#endif
+#ifdef HASFUSE
+	CSWAP(fuseindex); CSWAP(fuseindexsize); CSWAP(fuseindexvalid); CSWAP(fusecount);
+#endif
+#ifdef HASFOLD
+	CSWAP(foldindex); CSWAP(foldindexsize); CSWAP(foldindexvalid); CSWAP(folding); CSWAP(foldhits);
+#endif
+#ifdef HASPRATT
+	CSWAP(prattmode);
+#endif
+#ifdef HASSHORTCIRCUIT
+	CSWAP(shortcircuit); CSWAP(skipindex); CSWAP(skipindexsize); CSWAP(skipindexused); 
+	CSWAP(skipindexvalid); CSWAP(skipcount);
+#endif
+#ifdef HASPROFILER
+	CSWAP(profile); CSWAP(profilesize); CSWAP(profileused); CSWAP(profiling);
+	CSWAP(profileslot); CSWAP(profiletime); CSWAP(profilecount); CSWAP(profilefree);
+#endif
+#ifdef HASHEAPINDEX
+	CSWAP(heapindex); CSWAP(heapindexsize);
+#endif
+#ifdef HASCOMPILER
+	CSWAP(ccode); CSWAP(cstmt); CSWAP(clines);
+	CSWAP(csize); CSWAP(ncode); CSWAP(ncstmt); CSWAP(nclines);
+	CSWAP(ca); CSWAP(cpc); CSWAP(cfixup); CSWAP(cdepth); CSWAP(cmaxdepth);
+	CSWAP(cfail); CSWAP(cmode); CSWAP(cvalid); CSWAP(crunning); CSWAP(cstep);
+	CSWAP(cforcache); CSWAP(cgosubcache); CSWAP(cfallbacks);
+#endif
+	CSWAP(x); CSWAP(y); CSWAP(xc); CSWAP(yc); CSWAP(z);
+	CSWAP(ir); CSWAP(ir2); CSWAP(token); CSWAP(er); CSWAP(ert);
+	CSWAP(st); CSWAP(here); CSWAP(top); CSWAP(nvars); CSWAP(form); CSWAP(rd);
+	CSWAP(id); CSWAP(od); CSWAP(idd); CSWAP(odd);
+	CSWAP(ifd); CSWAP(ofd);
+	CSWAP(memconsole); CSWAP(consolesink); CSWAP(consoledata);
+	CSWAP(consoleinput); CSWAP(consoleinputsize); CSWAP(consoleinputpos);
+#ifdef HASBUDGET
+	CSWAP(budgeting); CSWAP(budgetstop); CSWAP(budget);
+	CSWAP(budgetlimit); CSWAP(timelimit); CSWAP(deadline);
+#endif
+}
+
+struct basiccontext* basiccreate(unsigned long n) {
+	struct basiccontext* c;
+
+	if (n < 2 || n-1 > maxaddr) return NULL;
+	c=calloc(1, sizeof(struct basiccontext));
+	if (c == NULL) return NULL;
+	c->mem=malloc(n);
+	if (c->mem == NULL) { free(c); return NULL; }
+	c->memsize=n-1;
+	c->himem=c->memsize;
+	c->stacksize=stacksize;
+#ifdef HASFORNEXT
+	c->fordepth=fordepth;
+#endif
+#ifdef HASGOSUB
+	c->gosubdepth=gosubdepth;
+#endif
+	c->idd=ISERIAL;
+	c->odd=OSERIAL;
+#ifdef HASFOLD
+	c->folding=TRUE;
+#endif
+
+	contextswap(c);
+	stackinit();
+#ifdef HASLINEINDEX
+	lineindexinit();
+#endif
+#ifdef HASHEAPINDEX
+	heapindexinit();
+#endif
+#ifdef HASFORINDEX
+	forindexinit();
+#endif
+#ifdef HASSHORTCIRCUIT
+	skipindexinit();
+#endif
+	iodefaults();
+	xnew();
+	contextswap(c);
+
+	if (c->stack == NULL) { basicdestroy(c); return NULL; }
+	return c;
+}
+
+void basicdestroy(struct basiccontext* c) {
+	if (c == NULL) return;
+	if (c->ifd) fclose(c->ifd);
+	if (c->ofd) fclose(c->ofd);
+	free(c->mem);
+	free(c->stack);
+#ifdef HASFORNEXT
+	free(c->forstack);
+#endif
+#ifdef HASGOSUB
+	free(c->gosubstack);
+#endif
+#ifdef HASLINEINDEX
+	free(c->lineindex);
+#endif
+#ifdef HASFORINDEX
+	free(c->forindex);
+#endif
+#ifdef HASVARINDEX
+	free(c->varindex);
+#endif
+#ifdef HASFUSE
+	free(c->fuseindex);
+#endif
+#ifdef HASFOLD
+	free(c->foldindex);
+#endif
+#ifdef HASSHORTCIRCUIT
+	free(c->skipindex);
+#endif
+#ifdef HASPROFILER
+	free(c->profile);
+#endif
+#ifdef HASHEAPINDEX
+	free(c->heapindex);
+#endif
+#ifdef HASCOMPILER
+	free(c->ccode);
+	free(c->cstmt);
+	free(c->clines);
+	free(c->cforcache);
+	free(c->cgosubcache);
+#endif
+	free(c);
+}
+
+// the line l is the input, the error of the line is returned
+signed char basicrun(struct basiccontext* c, char* l) {
+	short i=1;
+	signed char e;
+
+#ifdef HASOUTBUFFER
+	outflush();
+#endif
+	contextswap(c);
+	iodefaults();
+	while (i < BUFSIZE-1 && *l != 0 && *l != '\n' && *l != '\r') ibuffer[i++]=*l++;
+	ibuffer[i]=0;
+	ibuffer[0]=i-1;
+
+	bi=ibuffer;
+	nexttoken();
+	if (token == NUMBER) {
+		storeline();
+	} else {
+		st=SINT;
+		statement();
+	}
+	e=er;
+	if (er) reseterror();
+#ifdef HASOUTBUFFER
+	outflush();
+#endif
+	contextswap(c);
+	return e;
+}
+
+// output of the context goes to f, without f it is discarded
+void basicsink(struct basiccontext* c, void (*f)(char, void*), void* d) {
+	c->memconsole=TRUE;
+	c->consolesink=f;
+	c->consoledata=d;
+}
+
+// input is read from b which has to stay until the next call
+void basicinput(struct basiccontext* c, const char* b, long n) {
+	c->memconsole=TRUE;
+	c->consoleinput=b;
+	c->consoleinputsize=n;
+	c->consoleinputpos=0;
+}
+
+// enter the program text in b line by line
+void basicload(struct basiccontext* c, const char* b, long n) {
+	char l[BUFSIZE];
+	long i=0;
+	short j;
+
+	while (i < n) {
+		j=0;
+		while (i < n && b[i] != '\n') {
+			if (j < BUFSIZE-1) l[j++]=b[i];
+			i++;
+		}
+		l[j]=0;
+		i++;
+		(void) basicrun(c, l);
+	}
+}
+
+// RUN with at most n statements, with the limits of basiclimit() 
+// if n is 0, the error is returned or -1 if the budget stopped it
+int basicexec(struct basiccontext* c, unsigned long n) {
+	signed char e;
+#ifdef HASBUDGET
+	unsigned long l=c->budgetlimit;
+
+	if (n) c->budgetlimit=n;
+#endif
+	e=basicrun(c, "RUN");
+#ifdef HASBUDGET
+	c->budgetlimit=l;
+	if (c->budgetstop) return -1;
+#endif
+	return e;
+}
+
+// the limits of every RUN and CONT, n statements and t milliseconds, 
+// 0 is no limit
+void basiclimit(struct basiccontext* c, unsigned long n, unsigned long t) {
+#ifdef HASBUDGET
+	c->budgetlimit=n;
+	c->timelimit=t;
+#endif
+}
+
+// continue a stopped program like CONT
+int basicresume(struct basiccontext* c) {
+	signed char e;
+
+	e=basicrun(c, "CONT");
+#ifdef HASBUDGET
+	if (c->budgetstop) return -1;
+#endif
+	return e;
+}
+
+// the console input, at the end the program is stopped with the break 
+// character, INPUT ends on it
+char consoleread() {
+	if (consoleinputpos < consoleinputsize) return consoleinput[consoleinputpos++];
+	if (consoleinputpos++ == consoleinputsize) return BREAKCHAR;
+	consoleinputpos=consoleinputsize;
+	return '\n';
+}
+#endif
+
+/*
+	The statement budget counts the statements of a program run, 
+	statement() checks it before every statement. Every RUN 
+	and CONT starts with budgetlimit statements and timelimit 
+	milliseconds, the clock is read every 64 statements. When one 
+	of them is used up the program stops like on STOP and CONT 
+	continues it. Compiled code is not run with a budget.
+*/
+
+#ifdef HASBUDGET
+void budgetstart() {
+	budgeting=(budgetlimit > 0 || timelimit > 0);
+	budgetstop=FALSE;
+	if (budgetlimit > 0) budget=budgetlimit; else budget=~0UL;
+	deadline=micros()+timelimit*1000;
+}
+
+// called before every statement, CONT reads its first token again
+char budgetcheck() {
+	if (st != SRUN || token == LINENUMBER || token == ':') return FALSE;
+	if (budget == 0 || (timelimit > 0 && (budget & 63) == 0 && (long)(micros()-deadline) > 0)) {
+		switch (token) {
+			case NUMBER: 
+				here-=numsize+1; 
+				break;
+			case ARRAYVAR: 
+			case VARIABLE: 
+			case STRINGVAR: 
+				here-=3; 
+				break;
+			case STRING: 
+				here-=x+2; 
+				break;
+			default: 
+				here--;
+		}
+		st=SINT;
+		budgetstop=TRUE;
+		return TRUE;
+	}
+	budget--;
+	return FALSE;
+}
+#endif
+
+/*
+	The batch runner. Every job runs a program in a new context 
+	with its input and output in memory. The jobs are run by one 
+	forked worker per core, an idle worker takes the next job from 
+	a counter shared by all workers. 
+
+	basic -b dir runs all .bas files in dir, the input of prog.bas 
+	is prog.in if it exists, the output goes to prog.bas.out. 
+	basic -b prog.bas in... runs the program once for every input 
+	file and writes in.out. -j n sets the number of workers.
+*/
+
+#ifdef HASBATCH
+// the output of a job
+void bwrite(char c, void* d) {
+	char* p;
+
+	if (boutputlen == boutputsize) {
+		p=realloc(boutput, boutputsize+OBUFSIZE);
+		if (p == NULL) return;
+		boutput=p;
+		boutputsize+=OBUFSIZE;
+	}
+	boutput[boutputlen++]=c;
+}
+
+char* readfile(char* name, long* n) {
+	FILE* f;
+	char* b;
+
+	*n=0;
+	f=fopen(name, "rb");
+	if (!f) return NULL;
+	fseek(f, 0, SEEK_END);
+	*n=ftell(f);
+	fseek(f, 0, SEEK_SET);
+	b=malloc(*n+1);
+	if (b != NULL && fread(b, 1, *n, f) != *n) { free(b); b=NULL; }
+	if (b != NULL) b[*n]=0; else *n=0;
+	fclose(f);
+	return b;
+}
+
+// enter the program line by line, then RUN it 
+void batchjob(char* prog, char* in, char* out) {
+	struct basiccontext* c;
+	char *p, *i=NULL;
+	long n, ni=0;
+	FILE* f;
+
+	p=readfile(prog, &n);
+	if (p == NULL) { fprintf(stderr, "%s: cannot read\n", prog); return; }
+	c=basiccreate(memsize+1);
+	if (c == NULL) { fprintf(stderr, "%s: no memory\n", prog); free(p); return; }
+
+	if (in) i=readfile(in, &ni);
+	basicinput(c, i, ni);
+	boutputlen=0;
+	basicsink(c, bwrite, NULL);
+#ifdef HASBUDGET
+	basiclimit(c, 0, timelimit);
+#endif
+
+	basicload(c, p, n);
+	(void) basicexec(c, 0);
+
+	f=fopen(out, "wb");
+	if (!f || fwrite(boutput, 1, boutputlen, f) != boutputlen) fprintf(stderr, "%s: cannot write\n", out);
+	if (f) fclose(f);
+
+	basicdestroy(c);
+	free(i);
+	free(p);
+}
+
+// a are the paths after -b and w the number of workers
+void batch(char** a, int n, int w) {
+	char **prog, **in, **out;
+	int nj=0, m=n, i, j;
+	long k;
+	DIR* d;
+	struct dirent* de;
+	volatile long* next;
+
+	if (n == 0) return;
+	prog=malloc(sizeof(char*)*m);
+	in=malloc(sizeof(char*)*m);
+	out=malloc(sizeof(char*)*m);
+	if (!prog || !in || !out) return;
+
+	// the jobs of a directory or of input files
+	d=opendir(a[0]);
+	if (d) {
+		while ((de=readdir(d))) {
+			k=strlen(de->d_name);
+			if (k < 5 || strcmp(de->d_name+k-4, ".bas") != 0) continue;
+			if (nj == m) {
+				m*=2;
+				prog=realloc(prog, sizeof(char*)*m);
+				in=realloc(in, sizeof(char*)*m);
+				out=realloc(out, sizeof(char*)*m);
+				if (!prog || !in || !out) return;
+			}
+			prog[nj]=malloc(strlen(a[0])+k+2);
+			sprintf(prog[nj], "%s/%s", a[0], de->d_name);
+			in[nj]=malloc(strlen(prog[nj])+1);
+			strcpy(in[nj], prog[nj]);
+			strcpy(in[nj]+strlen(in[nj])-4, ".in");
+			if (access(in[nj], R_OK) != 0) { free(in[nj]); in[nj]=NULL; }
+			out[nj]=malloc(strlen(prog[nj])+5);
+			sprintf(out[nj], "%s.out", prog[nj]);
+			nj++;
+		}
+		closedir(d);
+	} else {
+		for (i=(n > 1); i<n; i++) {
+			prog[nj]=a[0];
+			in[nj]=(i > 0) ? a[i] : NULL;
+			out[nj]=malloc(strlen(a[i])+5);
+			sprintf(out[nj], "%s.out", a[i]);
+			nj++;
+		}
+	}
+
+	// the workers share the number of the next job
+	next=mmap(NULL, sizeof(long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (next == MAP_FAILED) return;
+	*next=0;
+	if (w > nj) w=nj;
+	outflush();
+	for (i=0; i<w; i++) {
+		if (fork() == 0) {
+			while ((j=__sync_fetch_and_add(next, 1)) < nj) {
+				batchjob(prog[j], in[j], out[j]);
+				printf("%s\n", out[j]);
+				fflush(stdout);
+			}
+			exit(0);
+		}
+	}
+	while (wait(NULL) > 0);
+}
+#endif
+
+// the state shared by all interpreters, the keyword index and the clock
+void basicinit() {
+#ifdef HASKEYWORDINDEX
+	keywordindexinit();
+#endif
+#ifndef ARDUINO
+#ifndef MINGW
+	timespec_get(&start_time, TIME_UTC);
+#endif
+#endif
+}
+
+#ifndef BASICLIB
 // the setup routine - Arduino style
 void setup() {
+	basicinit();
 #if MEMSIZE == 0
 	allocmem();
 	himem=memsize;
 #endif
-
-#ifndef ARDUINO
-#ifndef MINGW
-	timespec_get(&start_time, TIME_UTC);
+#ifdef HASDYNSTACKS
+	stackinit();
 #endif
+#ifdef HASLINEINDEX
+	lineindexinit();
+#endif
+#ifdef HASHEAPINDEX
+	heapindexinit();
+#endif
+#ifdef HASFORINDEX
+	forindexinit();
+#endif
+#ifdef HASSHORTCIRCUIT
+	skipindexinit();
 #endif
 	ioinit();
 	printmessage(MGREET); outspc();
@@ -5810,11 +9762,67 @@ void loop() {
     	top=0;
 	}
 }
+#endif
 
 
-#ifndef ARDUINO
-int main(){
+#if !defined(ARDUINO) && !defined(BASICLIB)
+int main(int argc, char* argv[]){
+	int i;
+#ifdef HASBATCH
+	char** paths=malloc(sizeof(char*)*argc);
+	int npaths=0;
+	char batchmode=FALSE;
+	int workers=sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	// command line options, -p profiles the lines of programs, 
+	// -m n allocates n bytes of memory, -s n, -g n and -f n set 
+	// the size of the arithmetic, gosub and for stack, -b runs 
+	// the following paths as a batch on -j n workers, -t n stops 
+	// programs after n milliseconds
+	for (i=1; i<argc; i++) {
+		if (argv[i][0] != '-') continue;
+#ifdef HASPROFILER
+		if (argv[i][1] == 'p') profiling=TRUE;
+#endif
+#if MEMSIZE == 0
+		if (argv[i][1] == 'm' && i+1 < argc) {
+			if (strtoul(argv[i+1], 0, 10) > maxaddr) memrequest=maxaddr; 
+			else memrequest=strtoul(argv[i+1], 0, 10);
+			i++;
+		}
+#endif
+#ifdef HASDYNSTACKS
+		if (argv[i][1] == 's' && i+1 < argc) { stacksize=atoi(argv[++i]); continue; }
+#ifdef HASGOSUB
+		if (argv[i][1] == 'g' && i+1 < argc) { gosubdepth=atoi(argv[++i]); continue; }
+#endif
+#ifdef HASFORNEXT
+		if (argv[i][1] == 'f' && i+1 < argc) { fordepth=atoi(argv[++i]); continue; }
+#endif
+#endif
+#ifdef HASBATCH
+		if (argv[i][1] == 'b') batchmode=TRUE;
+		if (argv[i][1] == 'j' && i+1 < argc) workers=atoi(argv[++i]);
+#endif
+#ifdef HASBUDGET
+		if (argv[i][1] == 't' && i+1 < argc) { timelimit=atol(argv[++i]); continue; }
+#endif
+	}
 	setup();
+#ifdef HASBATCH
+	if (batchmode) {
+		for (i=1; i<argc; i++) {
+			if (argv[i][0] == '-') { 
+				if (strchr("msgfjt", argv[i][1]) && argv[i][1] != 0) i++; 
+				continue; 
+			}
+			paths[npaths++]=argv[i];
+		}
+		batch(paths, npaths, workers > 0 ? workers : 1);
+		return 0;
+	}
+#endif
 	while (TRUE)
 		loop();
 }
@@ -0,0 +1,66 @@
+/*
+
+	basic.h - the interface of the interpreter as a library.
+
+	Compile basic.c with -DBASICLIB to leave out main(), e.g. 
+
+		gcc -O2 -c -DBASICLIB basic.c
+		ar rcs libbasic.a basic.o
+
+	All other functions and globals of basic.c are static in this 
+	build, the library exports only the names declared here.
+
+	Every context is an independent interpreter. Contexts are run 
+	one after another, they share the keyword tables set up by 
+	basicinit() which has to be called once before basiccreate().
+
+	The library is single threaded. A context is not an object the 
+	interpreter works on, basicrun() swaps its state into the globals 
+	of basic.c and back, and all contexts share the string, output 
+	and keyword buffers. At most one context may run at a time in a 
+	process, and all calls have to come from the same thread or be 
+	serialized by the caller. Use processes to run programs in parallel.
+
+*/
+
+#ifndef BASIC_H
+#define BASIC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct basiccontext;
+
+// the keyword index and the clock, once before the first context
+void basicinit();
+
+// a context with n bytes of BASIC memory, NULL if there is no memory
+struct basiccontext* basiccreate(unsigned long n);
+void basicdestroy(struct basiccontext* c);
+
+// the console of the context, output goes to f with d, input is read 
+// from b which has to stay until the next call
+void basicsink(struct basiccontext* c, void (*f)(char, void*), void* d);
+void basicinput(struct basiccontext* c, const char* b, long n);
+
+// enter the program text line by line
+void basicload(struct basiccontext* c, const char* b, long n);
+
+// run one line of input, the error code is returned
+signed char basicrun(struct basiccontext* c, char* l);
+
+// RUN with at most n statements, 0 keeps the limits of basiclimit(), 
+// the error code is returned or -1 if the budget stopped the program
+int basicexec(struct basiccontext* c, unsigned long n);
+
+// the limits of every RUN and CONT, n statements and t milliseconds, 
+// 0 is no limit, basicresume() continues a stopped program
+void basiclimit(struct basiccontext* c, unsigned long n, unsigned long t);
+int basicresume(struct basiccontext* c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
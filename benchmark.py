@@ -0,0 +1,94 @@
+#!/usr/bin/python3
+#
+# Benchmark for Stefan's tinybasic.
+#
+# Runs a fixed set of programs from testprograms/ and basicgames/
+# with scripted input and prints one line of JSON per program:
+#
+#   statements  statements executed, counted by the profiler (USR(9,6))
+#   seconds     wall time of the run without profiler
+#   sps         statements per second
+#   peak        peak memory use in bytes, memory size minus the least
+#               free memory himem-top during the run (USR(9,7))
+#
+# Usage: benchmark.py [interpreter] [repetitions]
+#
+# The interpreter defaults to ./basic, compile it with
+#   gcc -O2 -o basic basic.c
+# Each program is run the given number of times (default 3) and the
+# fastest run is reported.
+#
+
+import json
+import os
+import subprocess
+import sys
+import time
+
+# the programs and their input, the input is fed to the console
+# after RUN, all programs end by themselves
+programs = [
+	("testprograms/primes.bas", ["2000", "0"]),
+	("testprograms/euler9.bas", ["1000", "24000", "30000", "0"]),
+	("testprograms/fibo.bas", []),
+	("testprograms/array.bas", []),
+	("testprograms/string.bas", ["HELLOWORLD"]),
+	("basicgames/23matches.bas", ["1", "1", "1", "1", "1", "1"]),
+	("basicgames/bagels.bas", ["NO", "123", "456", "789", "147", "258", "369",
+		"159", "357", "102", "304", "506", "708", "910", "213", "546", "879",
+		"192", "384", "576", "768", "NO"]),
+	("basicgames/rocket.bas", ["NO"] + ["0"]*6 + ["200"]*30 + ["NO"]),
+]
+
+# the marker printed after the program has ended
+marker = "@@BENCHMARK"
+timeout = 60
+
+def run(basic, program, inputs, options):
+	script = 'LOAD "' + program + '"\nRUN\n'
+	for line in inputs:
+		script += line + "\n"
+	script += 'PRINT "' + marker + '";USR(9,6);" ";USR(9,7);" ";USR(0,5)\n'
+
+	# the interpreter never ends by itself, we read until the marker
+	start = time.time()
+	p = subprocess.Popen([basic] + options, stdin=subprocess.PIPE,
+		stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+	p.stdin.write(script.encode())
+	p.stdin.close()
+	out = b""
+	while True:
+		i = out.find(marker.encode())
+		if i >= 0 and b"\n" in out[i:]:
+			break
+		chunk = p.stdout.read1(65536)
+		if not chunk or time.time()-start > timeout:
+			p.kill()
+			p.wait()
+			return None
+		out = out[-4096:] + chunk
+	seconds = time.time()-start
+	p.kill()
+	p.wait()
+	result = out[i+len(marker):].split(b"\n")[0].split()
+	return seconds, [int(v) for v in result]
+
+def main():
+	basic = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else "./basic")
+	repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+	os.chdir(os.path.dirname(os.path.abspath(__file__)))
+
+	for program, inputs in programs:
+		profiled = run(basic, program, inputs, ["-p"])
+		times = [run(basic, program, inputs, []) for i in range(repeat)]
+		if profiled is None or None in times:
+			print(json.dumps({"program": program, "error": "timeout"}))
+			continue
+		statements, free, memsize = profiled[1]
+		seconds = min(t[0] for t in times)
+		print(json.dumps({"program": program, "statements": statements,
+			"seconds": round(seconds, 4), "sps": int(statements/seconds),
+			"peak": memsize-free}))
+		sys.stdout.flush()
+
+main()
@@ -0,0 +1,148 @@
+#!/usr/bin/python3
+#
+# Random expression test for Stefan's tinybasic.
+#
+# Generates programs of random expressions and runs each of them with
+# the expression evaluators of the interpreter switched on and off
+#
+#   SET 14  constant folding
+#   SET 15  the one loop evaluator instead of the recursive descent
+#   SET 16  short circuit AND and OR
+#
+# All runs must print the same. Divisions only have nonzero numbers
+# or variables as divisors and no expression has a side effect, so
+# the values cannot depend on the evaluator. Prints the expressions
+# that differ and one line of JSON per program.
+#
+# Usage: exprtest.py [interpreter] [seed] [programs]
+#
+# The interpreter defaults to ./basic, the seed to 1 and the number
+# of programs to 10. Each program has 500 PRINT statements.
+#
+
+import json
+import os
+import random
+import re
+import subprocess
+import sys
+import time
+
+# the settings of each run, the first one is the reference
+modes = [
+	("recursive", ["SET 14,0", "SET 15,0", "SET 16,0"]),
+	("fold", ["SET 14,1", "SET 15,0", "SET 16,0"]),
+	("oneloop", ["SET 14,0", "SET 15,1", "SET 16,0"]),
+	("shortcircuit", ["SET 14,0", "SET 15,0", "SET 16,1"]),
+	("all", ["SET 14,1", "SET 15,1", "SET 16,1"]),
+]
+
+# the variables are set in the first line of the program
+setup = "10 A=3: B=-2: C=0: DIM P(5): P(1)=4: P(2)=7"
+atoms = ["0", "1", "2", "3", "5", "7", "11", "A", "B", "C", "P(1)", "P(A)"]
+divisors = ["2", "3", "7", "A", "B", "P(2)"]
+operators = ["+", "-", "*", "/", "%", "+", "-", "*", "=", "<>", "<", ">",
+	"<=", ">=", " AND ", " OR "]
+statements = 500
+
+# the marker printed after the program has ended
+marker = "@@EXPRTEST"
+timeout = 60
+
+def operand(r, depth):
+	x = r.random()
+	if depth > 2 or x < 0.55:
+		return r.choice(atoms)
+	if x < 0.75:
+		return "(" + expression(r, depth+1) + ")"
+	if x < 0.85:
+		return "ABS(" + expression(r, depth+1) + ")"
+	return operand(r, depth+1)
+
+def expression(r, depth=0):
+	s = ""
+	if r.random() < 0.1:
+		s += "NOT "
+	if r.random() < 0.2:
+		s += r.choice(["-", "+"])
+	s += operand(r, depth)
+	for i in range(r.randint(0, 5)):
+		o = r.choice(operators)
+		s += o
+		if o == "/" or o == "%":
+			s += r.choice(divisors)
+		else:
+			s += operand(r, depth)
+	return s
+
+def program(r):
+	lines = [setup]
+	n = 20
+	while len(lines) <= statements:
+		e = expression(r)
+		if len(e) > 70:
+			continue
+		lines.append(str(n) + " PRINT " + e)
+		n += 10
+	return lines
+
+def run(basic, lines, settings):
+	script = "NEW\n"
+	for line in settings + lines:
+		script += line + "\n"
+	script += "RUN\n"
+	script += 'PRINT "' + marker + '"\n'
+
+	# the interpreter never ends by itself, we read until the marker
+	start = time.time()
+	p = subprocess.Popen([basic], stdin=subprocess.PIPE,
+		stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+	p.stdin.write(script.encode())
+	p.stdin.close()
+	out = b""
+	while True:
+		i = out.find(marker.encode())
+		if i >= 0 and b"\n" in out[i:]:
+			break
+		chunk = p.stdout.read1(65536)
+		if not chunk or time.time()-start > timeout:
+			p.kill()
+			p.wait()
+			return None
+		out = out + chunk
+	p.kill()
+	p.wait()
+
+	# one line for each PRINT right before the prompt of the marker
+	text = out[:i].decode(errors="replace")
+	return [re.sub("^(> )*", "", l) for l in text.split("\n")[-statements-1:-1]]
+
+def main():
+	basic = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else "./basic")
+	seed = int(sys.argv[2]) if len(sys.argv) > 2 else 1
+	count = int(sys.argv[3]) if len(sys.argv) > 3 else 10
+	failed = 0
+
+	for k in range(count):
+		lines = program(random.Random(seed+k))
+		outputs = [run(basic, lines, settings) for name, settings in modes]
+		differs = []
+		for (name, settings), out in zip(modes[1:], outputs[1:]):
+			if out is None or outputs[0] is None:
+				differs.append(name)
+				continue
+			for i, (a, b) in enumerate(zip(outputs[0], out)):
+				if a != b:
+					print(name + ": " + lines[i+1] + " prints " + b + 
+						" instead of " + a)
+					differs.append(name)
+					break
+		print(json.dumps({"seed": seed+k, "statements": statements,
+			"differs": differs}))
+		sys.stdout.flush()
+		if differs:
+			failed += 1
+
+	sys.exit(1 if failed else 0)
+
+main()
@@ -0,0 +1,19 @@
+100 REM "Stefan's BASIC whole array test program"
+110 REM "FILL, COPY, SUM, MIN, MAX and DOT on DIMed arrays"
+200 DIM A(10), B(12)
+210 FILL A, 3
+220 PRINT SUM(A), "=30"
+300 FOR I=1 TO 10 
+310 A(I)=I*I-20
+320 NEXT 
+330 PRINT MIN(A), "=-19", MAX(A), "=80"
+400 FILL B, 1
+410 COPY A TO B
+420 PRINT B(1), "=-19", B(10), "=80", B(11), "=1"
+430 PRINT SUM(B), "=187"
+500 DIM C(10)
+510 FILL C, 2
+520 PRINT DOT(A, C), "=370"
+700 REM "DOT needs arrays of equal length"
+710 PRINT DOT(A, B)
+720 END
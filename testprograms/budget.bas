@@ -0,0 +1,10 @@
+100 REM "Stefan's BASIC statement limit test program"
+110 REM "SET 12,1000 stops RUN and CONT after about 1000"
+120 REM "statements, USR(9,10) is then 1 and N tells how far"
+130 REM "it got, CONT goes on where it stopped until N is 3000"
+200 N=0
+210 FOR I=1 TO 3000
+220 N=N+1
+230 NEXT 
+240 PRINT N, "=3000"
+250 END
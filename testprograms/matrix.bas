@@ -0,0 +1,38 @@
+100 REM "Stefan's BASIC matrix test program"
+110 REM "Arrays with more than one subscript, the last"
+120 REM "subscript runs fastest, one subscript counts"
+130 REM "the elements in this order"
+200 DIM A(3,4), C(2,2,2)
+210 FOR I=1 TO 3
+220 FOR J=1 TO 4
+230 A(I,J)=10*I+J
+240 NEXT 
+250 NEXT 
+300 FOR K=1 TO 12
+310 PRINT A(K);" ";
+320 NEXT 
+330 PRINT 
+340 PRINT A(2,3), "=23"
+400 FOR I=1 TO 2
+410 FOR J=1 TO 2
+420 FOR K=1 TO 2
+430 C(I,J,K)=100*I+10*J+K
+440 NEXT 
+450 NEXT 
+460 NEXT 
+470 PRINT C(2,1,2), "=212", C(6), "=212"
+500 REM "the matrix product of A and its transpose"
+510 DIM P(3,3)
+520 FOR I=1 TO 3
+530 FOR J=1 TO 3
+540 S=0
+550 FOR K=1 TO 4
+560 S=S+A(I,K)*A(J,K)
+570 NEXT 
+580 P(I,J)=S
+590 NEXT 
+600 NEXT 
+610 PRINT P(1,1), "=630", P(2,3), "=2930"
+700 REM "a subscript out of its extent is an error"
+710 PRINT A(1,5)
+720 END
@@ -0,0 +1,15 @@
+100 REM "Stefan's BASIC profiler test program"
+110 REM "Start basic -p or type SET 8,1 before RUN, then"
+120 REM "PROFILE lists the lines that took the most time"
+130 REM "with their time in microseconds and their count"
+200 S=0
+210 FOR I=1 TO 200
+220 FOR J=1 TO 20
+230 S=S+I%J
+240 NEXT 
+250 NEXT 
+260 PRINT S, "=18840"
+300 REM "the statements counted, 0 without the profiler"
+310 PRINT USR(9,6)
+320 PROFILE 3
+330 END